@@ -4,29 +4,36 @@
 # See accompanying file LICENSE_1_0.txt or copy at
 #   http://www.boost.org/LICENSE_1_0.txt
 
-execute_process(COMMAND ${CMAKE_COMMAND} -E remove_directory "${DST_REPO}")
+# Rewrites each of the space-separated SUPERPROJECTS, in the current
+# directory, into a fresh repository named with SUFFIX appended.
 
-execute_process(COMMAND ${CMAKE_COMMAND} -E make_directory "${DST_REPO}"
-  ERROR_VARIABLE message
-  RESULT_VARIABLE result)
-if(NOT result EQUAL 0)
-  message(FATAL_ERROR "Failed to create directory ${DST_REPO}: ${message}")
-endif()
+separate_arguments(superprojects UNIX_COMMAND "${SUPERPROJECTS}")
 
-execute_process(COMMAND ${GIT} init --bare
-  WORKING_DIRECTORY "${DST_REPO}"
-  ERROR_VARIABLE message
-  RESULT_VARIABLE result)
-if(NOT result EQUAL 0)
-  message(FATAL_ERROR "Failed to initialize repository ${DST_REPO}: ${message}")
-endif()
+set(repo_name_args)
+foreach(name IN LISTS superprojects)
+  set(dst_repo "${name}${SUFFIX}")
+  execute_process(COMMAND ${CMAKE_COMMAND} -E remove_directory "${dst_repo}")
+
+  execute_process(COMMAND ${CMAKE_COMMAND} -E make_directory "${dst_repo}"
+    ERROR_VARIABLE message
+    RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Failed to create directory ${dst_repo}: ${message}")
+  endif()
+
+  execute_process(COMMAND ${GIT} init --bare
+    WORKING_DIRECTORY "${dst_repo}"
+    ERROR_VARIABLE message
+    RESULT_VARIABLE result)
+  if(NOT result EQUAL 0)
+    message(FATAL_ERROR "Failed to initialize repository ${dst_repo}: ${message}")
+  endif()
 
-get_filename_component(REPO_NAME "${SRC_REPO}" NAME)
+  list(APPEND repo_name_args --repo-name "${name}")
+endforeach()
 
-execute_process(COMMAND bash -e -o pipefail -c
-  "( cd '${SRC_REPO}' && '${GIT}' fast-export --all ) | (
-    '${FIX_SUBMODULE_REFS}' --rules '${RULES_FILE}' --repo-name '${REPO_NAME}' ) | (
-    cd '${DST_REPO}' && '${GIT}' fast-import --quiet --force )"
+execute_process(COMMAND "${FIX_SUBMODULE_REFS}"
+    --rules "${RULES_FILE}" --git "${GIT}" --fixup-suffix "${SUFFIX}" ${repo_name_args}
   ERROR_VARIABLE message
   RESULT_VARIABLE result)
 if(NOT result EQUAL 0)
@@ -0,0 +1,260 @@
+# Copyright Dave Abrahams 2013. Distributed under the Boost
+# Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#!/usr/bin/env python
+"""
+Convert disjoint ranges of SVN revisions in parallel, then stitch the
+results together.
+
+Shard k converts revisions (b[k], b[k+1]] in its own directory,
+shard-k.  Every shard but the first starts with --snapshot, so each
+ref's first commit there holds the whole tree as of b[k]+1.  Stitching
+replays each shard's history into the final repositories with
+"git fast-export | git fast-import".  The first commit of each ref in
+the shard gets the ref's tip from the previous shards as its parent,
+and a "deleteall" so that its tree is exactly the snapshot; later
+commits are exported as changes from their parents in the shard, as
+usual.  If that first commit didn't change the tree, it is dropped.
+
+Limitations:
+
+  * SVN merges whose source lies in an earlier shard are lost; svn2git
+    warns about each one as it converts the shard.
+
+  * Superprojects (--superproject) are stitched last.  svn2git writes
+    their gitlinks as the SHAs of the submodule commits in the same
+    shard, and stitching maps those to the submodules' stitched
+    commits.  So the shards can't be converted with --gitlink-marks,
+    and no "submodules" step is needed afterwards.
+
+Usage:
+  shard_conversion.py --shards N --svnrepo PATH --rules FILE
+      [--superproject NAME]... [--svn2git EXE] [--git EXE] [--output DIR]
+      [-- extra svn2git arguments]
+"""
+
+import argparse, os, re, shutil, subprocess, sys
+
+def git(args, git_dir, **kw):
+    return subprocess.check_output([options.git] + args, env=dict(os.environ, GIT_DIR=git_dir), **kw)
+
+def latest_revision(svn_repo):
+    return int(subprocess.check_output(['svnlook', 'youngest', svn_repo]).strip())
+
+def convert_shards(max_rev):
+    bounds = [max_rev * k // options.shards for k in range(options.shards + 1)]
+    processes = []
+    for k in range(options.shards):
+        shard_dir = os.path.join(options.output, 'shard-%d' % k)
+        if os.path.exists(shard_dir):
+            shutil.rmtree(shard_dir)
+        os.makedirs(shard_dir)
+        cmd = [options.svn2git, '--svnrepo', options.svnrepo, '--rules', options.rules,
+               '--resume-from', str(bounds[k]), '--max-rev', str(bounds[k + 1])]
+        if k > 0:
+            cmd.append('--snapshot')
+        cmd += options.svn2git_args
+        log = open(os.path.join(shard_dir, 'svn2git.log'), 'w')
+        processes.append(subprocess.Popen(cmd, cwd=shard_dir, stdout=log, stderr=subprocess.STDOUT))
+
+    failed = [k for k, p in enumerate(processes) if p.wait() != 0]
+    if failed:
+        sys.exit('shards %s failed; see their svn2git.log' % failed)
+
+def repository_names(shard_dir):
+    names = []
+    for root, dirs, files in os.walk(shard_dir):
+        if 'HEAD' in files and 'objects' in dirs:
+            names.append(os.path.relpath(root, shard_dir))
+            dirs[:] = []
+    return names
+
+def first_parent_roots(git_dir):
+    """Map each ref's first commit in a shard to that ref's name"""
+    roots = {}
+    for line in git(['show-ref'], git_dir).decode().splitlines():
+        sha, ref = line.split(' ', 1)
+        chain = git(['rev-list', '--first-parent', ref], git_dir).split()
+        if chain:
+            roots[chain[-1].decode()] = ref
+    return roots
+
+def ref_tips(git_dir):
+    if not os.path.exists(git_dir):
+        return {}
+    try:
+        lines = git(['show-ref'], git_dir).decode().splitlines()
+    except subprocess.CalledProcessError:  # No refs yet
+        return {}
+    return dict(reversed(line.split(' ', 1)) for line in lines)
+
+def tree_of(commit, git_dir):
+    return git(['rev-parse', commit + '^{tree}'], git_dir).decode().strip()
+
+data_re = re.compile(br'^data (\d+)$')
+
+header_re = re.compile(br'^(mark|original-oid|author|committer|encoding|data) ')
+
+def stitch_stream(src, dst, roots, tips, shard_repo, final_repo, shas, marks):
+    """
+    Copy fast-export output from src to dst, giving each ref's first
+    commit its parent from the previous shards and mapping submodule
+    SHAs through shas.  marks receives the original SHA of each
+    commit's mark.
+    """
+    aliases = {}    # Marks of dropped commits => the commits that stand in for them
+    header = None   # The lines of a commit header being read
+
+    def copy_data(line, out):
+        out.write(line)
+        m = data_re.match(line.rstrip(b'\n'))
+        if m:
+            out.write(src.read(int(m.group(1))))
+
+    while True:
+        line = src.readline()
+        if not line:
+            break
+
+        if header is not None:
+            if header_re.match(line):
+                header.append(line)
+                m = data_re.match(line.rstrip(b'\n'))
+                if m:
+                    header.append(src.read(int(m.group(1))))
+                continue
+
+            # The header is complete; decide whether to stitch
+            mark = orig = None
+            for h in header:
+                if h.startswith(b'mark :'):
+                    mark = h[6:].strip()
+                elif h.startswith(b'original-oid '):
+                    orig = h[13:].strip().decode()
+            header = [h for h in header if not h.startswith(b'original-oid ')]
+            if mark and orig:
+                marks[mark.decode()] = orig
+
+            ref = roots.get(orig)
+            parent = ref and tips.get(ref)
+            if parent and not line.startswith(b'from '):
+                if tree_of(orig, shard_repo) == tree_of(parent, final_repo):
+                    # Nothing changed since the previous shard; drop
+                    # this commit and its file changes
+                    aliases[mark] = parent.encode()
+                    shas[orig] = parent
+                    with open(os.devnull, 'wb') as discard:
+                        while line.strip():
+                            copy_data(line, discard)
+                            line = src.readline()
+                    header = None
+                    continue
+                # Being a root, its file changes list the whole tree;
+                # replace the parent's rather than adding to it
+                header.append(b'from ' + parent.encode() + b'\n')
+                header.append(b'deleteall\n')
+
+            for h in header:
+                dst.write(h)
+            header = None
+
+        if line.startswith(b'commit '):
+            header = [line]
+            continue
+
+        if line.startswith(b'from :') or line.startswith(b'merge :'):
+            kind, mark = line.split(b' :', 1)
+            mark = mark.strip()
+            if mark in aliases:
+                line = kind + b' ' + aliases[mark] + b'\n'
+        elif line.startswith(b'M 160000 '):
+            sha = line[9:49].decode()
+            if sha in shas:
+                line = line[:9] + shas[sha].encode() + line[49:]
+
+        copy_data(line, dst)
+
+def stitch_repository(name, shas):
+    final_repo = os.path.join(options.output, name)
+    if not os.path.exists(final_repo):
+        os.makedirs(final_repo)
+        git(['init', '--bare', '--quiet'], final_repo)
+
+    for k in range(options.shards):
+        shard_dir = os.path.join(options.output, 'shard-%d' % k)
+        shard_repo = os.path.join(shard_dir, name)
+        if not os.path.exists(shard_repo):
+            continue
+        print('stitching %s from shard %d' % (name, k))
+
+        roots = first_parent_roots(shard_repo) if k > 0 else {}
+        tips = ref_tips(final_repo)
+        marks_file = os.path.join(final_repo, 'stitch-marks')
+
+        export = subprocess.Popen(
+            [options.git, 'fast-export', '--all', '--signed-tags=strip', '--show-original-ids'],
+            env=dict(os.environ, GIT_DIR=shard_repo), stdout=subprocess.PIPE)
+        import_ = subprocess.Popen(
+            [options.git, 'fast-import', '--quiet', '--force', '--export-marks=' + marks_file],
+            env=dict(os.environ, GIT_DIR=final_repo), stdin=subprocess.PIPE)
+        marks = {}
+        stitch_stream(export.stdout, import_.stdin, roots, tips, shard_repo, final_repo, shas, marks)
+        import_.stdin.close()
+
+        for p in (export, import_):
+            if p.wait() != 0:
+                sys.exit('stitching %s from shard %d failed' % (name, k))
+
+        # Remember where each of the shard's commits ended up, for
+        # superprojects' submodule references
+        for line in open(marks_file):
+            mark, sha = line.split()
+            orig = marks.get(mark[1:])
+            if orig:
+                shas[orig] = sha
+        os.remove(marks_file)
+
+def fast_import_has_get_mark():
+    """True iff git fast-import answers "get-mark", which it learned in git 2.6"""
+    version = subprocess.check_output([options.git, '--version']).decode()
+    match = re.search(r'(\d+)\.(\d+)', version)
+    return match is not None and tuple(map(int, match.groups())) >= (2, 6)
+
+def run():
+    global options
+    parser = argparse.ArgumentParser(description='Convert SVN history in parallel shards')
+    parser.add_argument('--shards', type=int, required=True)
+    parser.add_argument('--svnrepo', required=True)
+    parser.add_argument('--rules', required=True)
+    parser.add_argument('--max-rev', type=int, default=0)
+    parser.add_argument('--superproject', action='append', default=[])
+    parser.add_argument('--svn2git', default='svn2git')
+    parser.add_argument('--git', default='git')
+    parser.add_argument('--output', default='.')
+    parser.add_argument('--stitch-only', action='store_true',
+                        help='stitch the results of an earlier run')
+    parser.add_argument('svn2git_args', nargs=argparse.REMAINDER)
+    options = parser.parse_args()
+    options.svn2git_args = [a for a in options.svn2git_args if a != '--']
+    if '--gitlink-marks' in options.svn2git_args:
+        sys.exit('stitching needs gitlinks that hold SHAs; drop --gitlink-marks')
+    if options.superproject and not fast_import_has_get_mark():
+        # svn2git would fall back to writing marks
+        sys.exit('stitching superprojects needs git 2.6 or later, for fast-import\'s get-mark')
+    options.rules = os.path.abspath(options.rules)
+    options.svnrepo = os.path.abspath(options.svnrepo)
+
+    if not options.stitch_only:
+        convert_shards(options.max_rev or latest_revision(options.svnrepo))
+
+    names = set()
+    for k in range(options.shards):
+        names.update(repository_names(os.path.join(options.output, 'shard-%d' % k)))
+
+    # Submodules first, so superprojects can refer to their final SHAs
+    shas = {}
+    for name in sorted(names, key=lambda n: (n in options.superproject, n)):
+        stitch_repository(name, shas)
+
+if __name__ == '__main__':
+    run()
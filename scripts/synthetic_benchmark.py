@@ -0,0 +1,266 @@
+# Copyright Dave Abrahams 2013. Distributed under the Boost
+# Software License, Version 1.0. (See accompanying
+# file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#!/usr/bin/env python
+"""
+Measure svn2git on a synthetic SVN repository of a given shape.
+
+The repository is laid out like Boost's: each of --projects projects
+lives in libs/<project>/ of /trunk, and of every branch and tag, which
+are copies of /trunk made every --copy-every revisions.  Each revision
+after the first changes --files-per-revision files, mostly on trunk,
+sometimes on an existing branch, occasionally adding a file.  The
+ruleset maps each project to its own Git repository, with trunk as
+master and every branch and tag as a ref.
+
+The repository is written as an "svnadmin dump" stream and loaded with
+svnadmin; that part isn't measured.  svn2git then converts it once in
+each requested mode ("dry-run", "real" and/or "dump"), and for each run
+we report revisions/sec, the rate at which file contents were read from
+SVN and written to Git, and peak RSS.  The "dump" mode converts with
+--svndump from the dump stream into an empty repository, so its time
+includes loading.
+
+Usage:
+  synthetic_benchmark.py --svn2git EXE [--git EXE] [--svnadmin EXE]
+      [--workdir DIR] [--modes dry-run,real,dump] [shape options...]
+      [-- extra svn2git arguments]
+"""
+
+import argparse, json, os, random, shutil, subprocess, sys, time
+
+class Dump(object):
+    """Writes an svnadmin dump stream (format version 2, full texts)"""
+
+    def __init__(self, out):
+        self.out = out
+        self.text_bytes = 0
+        out.write(b'SVN-fs-dump-format-version: 2\n\n'
+                  b'UUID: 00000000-0000-0000-0000-000000000000\n\n')
+
+    @staticmethod
+    def props(pairs):
+        body = b''
+        for k, v in pairs:
+            k, v = k.encode(), v.encode()
+            body += b'K %d\n%s\nV %d\n%s\n' % (len(k), k, len(v), v)
+        return body + b'PROPS-END\n'
+
+    def revision(self, revnum, log):
+        date = time.strftime('%Y-%m-%dT%H:%M:%S.000000Z', time.gmtime(1000000000 + revnum * 600))
+        props = self.props([('svn:log', log), ('svn:author', 'bench'), ('svn:date', date)])
+        self.out.write(b'Revision-number: %d\nProp-content-length: %d\nContent-length: %d\n\n'
+                       % (revnum, len(props), len(props)))
+        self.out.write(props + b'\n')
+
+    def node(self, path, kind, action, text=None, copyfrom=None):
+        headers = [b'Node-path: ' + path.encode()]
+        if kind:
+            headers.append(b'Node-kind: ' + kind)
+        headers.append(b'Node-action: ' + action)
+        if copyfrom:
+            headers.append(b'Node-copyfrom-rev: %d' % copyfrom[1])
+            headers.append(b'Node-copyfrom-path: ' + copyfrom[0].encode())
+
+        # New nodes get an empty property list
+        props = self.props([]) if action == b'add' and not copyfrom else b''
+        content = props + (text or b'')
+        if props:
+            headers.append(b'Prop-content-length: %d' % len(props))
+        if text is not None:
+            headers.append(b'Text-content-length: %d' % len(text))
+            self.text_bytes += len(text)
+        if props or text is not None:
+            headers.append(b'Content-length: %d' % len(content))
+        self.out.write(b'\n'.join(headers) + b'\n\n' + content + b'\n\n')
+
+def file_contents(rng, size):
+    size = rng.randint(max(1, size // 2), size * 3 // 2)
+    line = bytes(bytearray(rng.randint(32, 126) for _ in range(79))) + b'\n'
+    return (line * (size // len(line) + 1))[:size]
+
+def generate(dump, shape):
+    """Write the repository's history to dump, returning the names of
+    the branches and tags it creates"""
+    rng = random.Random(shape.seed)
+    trees = {'trunk': {}}       # Root directory => {file path: True}
+    dirs = set()
+    branches, tags = [], []
+
+    def add_dirs(path):
+        parts = path.split('/')[:-1]
+        for i in range(1, len(parts) + 1):
+            d = '/'.join(parts[:i])
+            if d not in dirs:
+                dump.node(d, b'dir', b'add')
+                dirs.add(d)
+
+    def add_file(root, path):
+        full = root + '/' + path
+        add_dirs(full)
+        dump.node(full, b'file', b'add', file_contents(rng, shape.file_size))
+        trees[root][path] = True
+
+    # r1 lays out the tree and the first files of each project
+    dump.revision(1, 'initial layout')
+    for d in ('trunk', 'branches', 'tags'):
+        dump.node(d, b'dir', b'add')
+        dirs.add(d)
+    for p in range(shape.projects):
+        for f in range(shape.files_per_project):
+            add_file('trunk', 'libs/p%d/d%d/f%d.txt' % (p, f % 10, f))
+
+    for revnum in range(2, shape.revisions + 1):
+        if revnum % shape.copy_every == 0:
+            # Alternate between branches and tags
+            if len(branches) <= len(tags):
+                name, kind, names = 'b%d' % len(branches), 'branches', branches
+            else:
+                name, kind, names = 't%d' % len(tags), 'tags', tags
+            root = kind + '/' + name
+            dump.revision(revnum, 'create ' + root)
+            dump.node(root, b'dir', b'add', copyfrom=('trunk', revnum - 1))
+            trees[root] = dict(trees['trunk'])
+            dirs.update(root + d[len('trunk'):] for d in list(dirs) if d.startswith('trunk/'))
+            dirs.add(root)
+            names.append(name)
+            continue
+
+        dump.revision(revnum, 'change %d files' % shape.files_per_revision)
+        root = 'trunk'
+        if branches and rng.random() < shape.branch_fraction:
+            root = 'branches/' + rng.choice(branches)
+        files = sorted(trees[root])
+        for path in rng.sample(files, min(len(files), shape.files_per_revision)):
+            if rng.random() < shape.add_fraction:
+                p = rng.randrange(shape.projects)
+                path = 'libs/p%d/d%d/new%d.txt' % (p, rng.randrange(10), revnum)
+                if path not in trees[root]:
+                    add_file(root, path)
+                    continue
+            dump.node(root + '/' + path, b'file', b'change', file_contents(rng, shape.file_size))
+
+    return branches, tags
+
+def write_rules(filename, shape, branches, tags):
+    with open(filename, 'w') as rules:
+        rules.write('abstract repository common_branches\n{\n  branches\n  {\n'
+                    '    [:] "/trunk/" : "master";\n')
+        for b in branches:
+            rules.write('    [:] "/branches/%s/" : "%s";\n' % (b, b))
+        rules.write('  }\n  tags\n  {\n')
+        for t in tags:
+            rules.write('    [:] "/tags/%s/" : "%s";\n' % (t, t))
+        rules.write('  }\n}\n\n')
+        for p in range(shape.projects):
+            rules.write('repository p%d : common_branches\n{\n  content\n  {\n'
+                        '    "libs/p%d/";\n  }\n}\n\n' % (p, p))
+
+def run_svn2git(mode, svn_repo, dump_file, rules, workdir):
+    out_dir = os.path.join(workdir, mode)
+    if os.path.exists(out_dir):
+        shutil.rmtree(out_dir)
+    os.makedirs(out_dir)
+    stats_file = os.path.join(out_dir, 'stats.json')
+
+    if mode == 'dump':
+        svn_repo = os.path.join(out_dir, 'svn')
+    cmd = [options.svn2git, '--svnrepo', svn_repo, '--rules', rules,
+           '--stats', stats_file, '--quiet']
+    if mode == 'dump':
+        cmd += ['--svndump', dump_file]
+    if options.git:
+        cmd += ['--git', options.git]
+    if mode == 'dry-run':
+        cmd.append('--dry-run')
+    cmd += options.svn2git_args
+
+    with open(os.path.join(out_dir, 'svn2git.log'), 'w') as log:
+        start = time.time()
+        process = subprocess.Popen(cmd, cwd=out_dir, stdout=log, stderr=subprocess.STDOUT)
+        _, status, usage = os.wait4(process.pid, 0)
+        elapsed = time.time() - start
+    if status != 0:
+        sys.exit('svn2git failed in %s mode; see %s' % (mode, log.name))
+
+    with open(stats_file) as f:
+        stats = json.load(f)
+
+    # ru_maxrss is in kilobytes on Linux, bytes on Mac OS
+    peak_rss = usage.ru_maxrss * (1 if sys.platform == 'darwin' else 1024)
+    git_bytes = sum(r['bytes_written'] for r in stats['repositories'].values())
+    return dict(
+        mode=mode, seconds=elapsed, revisions=stats['revisions'],
+        revisions_per_second=stats['revisions'] / elapsed,
+        git_bytes_per_second=git_bytes / elapsed,
+        peak_rss_bytes=peak_rss)
+
+def run():
+    global options
+    parser = argparse.ArgumentParser(description='Benchmark svn2git on a synthetic repository')
+    parser.add_argument('--svn2git', required=True)
+    parser.add_argument('--git', default=None)
+    parser.add_argument('--svnadmin', default='svnadmin')
+    parser.add_argument('--workdir', default='synthetic-benchmark')
+    parser.add_argument('--modes', default='dry-run,real')
+    parser.add_argument('--json', metavar='FILE', help='also write the results to FILE')
+
+    shape = parser.add_argument_group('repository shape')
+    shape.add_argument('--revisions', type=int, default=2000)
+    shape.add_argument('--projects', type=int, default=20,
+                       help='projects, and so Git repositories, in the ruleset')
+    shape.add_argument('--files-per-project', type=int, default=50)
+    shape.add_argument('--files-per-revision', type=int, default=5)
+    shape.add_argument('--copy-every', type=int, default=100,
+                       help='revisions between branch or tag copies of trunk')
+    shape.add_argument('--branch-fraction', type=float, default=0.2,
+                       help='fraction of changes made on a branch rather than trunk')
+    shape.add_argument('--add-fraction', type=float, default=0.1,
+                       help='fraction of changed files that are new')
+    shape.add_argument('--file-size', type=int, default=4096, help='average file size in bytes')
+    shape.add_argument('--seed', type=int, default=0)
+
+    parser.add_argument('svn2git_args', nargs=argparse.REMAINDER)
+    options = parser.parse_args()
+    options.svn2git_args = [a for a in options.svn2git_args if a != '--']
+    options.svn2git = os.path.abspath(options.svn2git)
+    options.workdir = os.path.abspath(options.workdir)
+
+    if not os.path.exists(options.workdir):
+        os.makedirs(options.workdir)
+    svn_repo = os.path.join(options.workdir, 'svn')
+    dump_file = os.path.join(options.workdir, 'svn.dump')
+    rules = os.path.join(options.workdir, 'rules.txt')
+
+    print('generating %d revisions...' % options.revisions)
+    with open(dump_file, 'wb') as out:
+        dump = Dump(out)
+        branches, tags = generate(dump, options)
+    write_rules(rules, options, branches, tags)
+
+    print('loading %d bytes of file contents into %s...' % (dump.text_bytes, svn_repo))
+    if os.path.exists(svn_repo):
+        shutil.rmtree(svn_repo)
+    subprocess.check_call([options.svnadmin, 'create', svn_repo])
+    with open(dump_file, 'rb') as dump_in:
+        subprocess.check_call([options.svnadmin, 'load', '--quiet', svn_repo], stdin=dump_in)
+
+    results = []
+    for mode in options.modes.split(','):
+        r = run_svn2git(mode, svn_repo, dump_file, rules, options.workdir)
+        r['svn_bytes_per_second'] = dump.text_bytes / r['seconds']
+        results.append(r)
+        print('%-8s %8.1f revisions/s  %8.2f MB/s from SVN  %8.2f MB/s to Git  '
+              '%7.1f MB peak RSS  (%.1fs)'
+              % (mode, r['revisions_per_second'], r['svn_bytes_per_second'] / 1e6,
+                 r['git_bytes_per_second'] / 1e6, r['peak_rss_bytes'] / 1e6, r['seconds']))
+
+    if options.json:
+        with open(options.json, 'w') as f:
+            json.dump(dict(shape=dict((k, getattr(options, k)) for k in (
+                'revisions', 'projects', 'files_per_project', 'files_per_revision',
+                'copy_every', 'branch_fraction', 'add_fraction', 'file_size', 'seed')),
+                           svn2git_args=options.svn2git_args, results=results), f, indent=2)
+
+if __name__ == '__main__':
+    run()
@@ -0,0 +1,153 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef BLOCK_READER_DWA2013806_HPP
+# define BLOCK_READER_DWA2013806_HPP
+
+# include "output_buffer.hpp"
+# include <boost/utility/string_ref.hpp>
+# include <algorithm>
+# include <cerrno>
+# include <cstring>
+# include <stdexcept>
+# include <string>
+# include <vector>
+# include <fcntl.h>
+# include <unistd.h>
+
+// Reads a command stream from a file descriptor in large blocks,
+// handing out its lines without copying them, and passing the bytes
+// in between (e.g. the payloads of "data" commands) straight through
+// to the output.  Payloads that aren't already buffered are spliced
+// from input to output when one of them is a pipe.
+class block_reader
+{
+ public:
+    block_reader(int fd, std::size_t capacity)
+        : fd(fd), buffer(capacity), begin(0), end(0), eof(false)
+    {}
+
+    // Read the next line, without its newline, into line, which stays
+    // valid until the next call.  Returns false at the end of input.
+    bool getline(boost::string_ref& line)
+    {
+        std::size_t scanned = begin;
+        for (;;)
+        {
+            char const* const start = buffer.data() + begin;
+            char const* const nl = static_cast<char const*>(
+                std::memchr(buffer.data() + scanned, '\n', end - scanned));
+            if (nl)
+            {
+                line = boost::string_ref(start, nl - start);
+                begin = nl + 1 - buffer.data();
+                return true;
+            }
+            scanned = end;
+            if (!fill())
+            {
+                // A last line without a newline
+                if (begin == end)
+                    return false;
+                line = boost::string_ref(buffer.data() + begin, end - begin);
+                begin = end;
+                return true;
+            }
+            scanned -= begin_moved;
+        }
+    }
+
+    // Pass the next n bytes of input to out_fd, after whatever out
+    // has buffered.
+    void forward(std::size_t n, output_buffer& out, int out_fd)
+    {
+        std::size_t const buffered = std::min(n, end - begin);
+        out.write(buffer.data() + begin, buffered);
+        begin += buffered;
+        n -= buffered;
+        if (n == 0)
+            return;
+
+        out.flush();
+        while (n > 0)
+        {
+            ssize_t const moved = ::splice(fd, nullptr, out_fd, nullptr, n, SPLICE_F_MORE);
+            if (moved > 0)
+            {
+                n -= moved;
+                continue;
+            }
+            if (moved == 0)
+                throw std::runtime_error("unexpected end of input");
+            if (errno == EINTR)
+                continue;
+            if (errno != EINVAL && errno != ENOSYS)
+                throw std::runtime_error(std::string("splice failed: ") + std::strerror(errno));
+
+            // Neither end is a pipe; copy through the buffer instead
+            while (n > 0)
+            {
+                begin = end = 0;
+                if (!fill())
+                    throw std::runtime_error("unexpected end of input");
+                std::size_t const chunk = std::min(n, end);
+                out.write(buffer.data(), chunk);
+                begin = chunk;
+                n -= chunk;
+            }
+        }
+    }
+
+ private:
+    // Read more input after what's buffered, making room first.
+    // Returns false at the end of input.  Sets begin_moved to how far
+    // the buffered bytes moved toward the front.
+    bool fill()
+    {
+        begin_moved = 0;
+        if (eof)
+            return false;
+
+        if (end == buffer.size())
+        {
+            if (begin > 0)
+            {
+                std::memmove(buffer.data(), buffer.data() + begin, end - begin);
+                begin_moved = begin;
+                end -= begin;
+                begin = 0;
+            }
+            else
+            {
+                // One line fills the buffer
+                buffer.resize(buffer.size() * 2);
+            }
+        }
+
+        for (;;)
+        {
+            ssize_t const n = ::read(fd, buffer.data() + end, buffer.size() - end);
+            if (n > 0)
+            {
+                end += n;
+                return true;
+            }
+            if (n == 0)
+            {
+                eof = true;
+                return false;
+            }
+            if (errno != EINTR)
+                throw std::runtime_error(std::string("read failed: ") + std::strerror(errno));
+        }
+    }
+
+ private:
+    int fd;
+    std::vector<char> buffer;
+    std::size_t begin, end;  // The unconsumed, buffered input
+    std::size_t begin_moved;
+    bool eof;
+};
+
+#endif // BLOCK_READER_DWA2013806_HPP
@@ -0,0 +1,315 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// See svn.cpp
+#define SVN_DEPRECATED
+
+#include "file_prefetcher.hpp"
+#include "apr_pool.hpp"
+#include "svn.hpp"
+#include "to_string.hpp"
+#include "sha1.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <svn_fs.h>
+#include <svn_repos.h>
+#include <apr_hash.h>
+#include <algorithm>
+#include <stdexcept>
+
+struct file_prefetcher::worker
+{
+    explicit worker(std::string const& repo_path)
+        : repos(svn::call(svn_repos_open, repo_path.c_str(), pool)),
+          fs(svn_repos_fs(repos)),
+          revnum(-1),
+          fs_root(nullptr)
+    {}
+
+    svn_fs_root_t* root(int revnum);
+    void read(int revnum, path const& svn_path, contents& result);
+
+    AprPool pool;
+    svn_repos_t* repos;
+    svn_fs_t* fs;
+
+    // The revision root currently in use, and the pool it lives in
+    int revnum;
+    AprPool root_pool;
+    svn_fs_root_t* fs_root;
+};
+
+extern "C"
+{
+    static svn_error_t *append_to_string(void *baton, const char *data, apr_size_t *len)
+    {
+        static_cast<std::string*>(baton)->append(data, *len);
+        return SVN_NO_ERROR;
+    }
+}
+
+svn_fs_root_t* file_prefetcher::worker::root(int revnum)
+{
+    if (revnum != this->revnum)
+    {
+        root_pool = pool.make_subpool();
+        fs_root = svn::call(svn_fs_revision_root, fs, revnum, root_pool);
+        this->revnum = revnum;
+    }
+    return fs_root;
+}
+
+void file_prefetcher::worker::read(int revnum, path const& svn_path, contents& result)
+{
+    svn_fs_root_t* const fs_root = root(revnum);
+    AprPool scope = root_pool.make_subpool();
+
+    result.executable = svn::call(
+        svn_fs_node_prop, fs_root, svn_path.c_str(), "svn:executable", scope) != nullptr;
+
+    result.data.reserve(
+        svn::call(svn_fs_file_length, fs_root, svn_path.c_str(), scope));
+
+    svn_stream_t* in_stream = svn::call(
+        svn_fs_file_contents, fs_root, svn_path.c_str(), scope);
+    svn_stream_t* out_stream = svn_stream_create(&result.data, scope);
+    svn_stream_set_write(out_stream, append_to_string);
+    check_svn(svn_stream_copy3(in_stream, out_stream, nullptr, nullptr, scope));
+
+    result.sha = git_blob_sha(result.data.data(), result.data.size());
+}
+
+// Call f for each file at or beneath svn_path, a node of the given
+// kind, in the order in which the importer visits them, until f
+// returns false.  Directories in skipped are not entered.  Returns
+// false iff f did.
+template <class F>
+static bool walk(
+    svn_fs_root_t* fs_root, path const& svn_path, svn_node_kind_t kind,
+    std::vector<path> const& skipped, AprPool const& pool, F const& f)
+{
+    if (boost::contains(svn_path.str(), "/CVSROOT/"))
+        return true;
+
+    if (kind == svn_node_file)
+        return f(svn_path);
+
+    if (kind != svn_node_dir
+        || std::binary_search(skipped.begin(), skipped.end(), svn_path))
+        return true;
+
+    std::vector<std::pair<std::string, svn_node_kind_t> > entries;
+    {
+        AprPool scope = pool.make_subpool();
+        apr_hash_t* dirents = svn::call(svn_fs_dir_entries, fs_root, svn_path.c_str(), scope);
+        for (apr_hash_index_t* i = apr_hash_first(scope, dirents); i; i = apr_hash_next(i))
+        {
+            void* value;
+            apr_hash_this(i, nullptr, nullptr, &value);
+            svn_fs_dirent_t const* entry = static_cast<svn_fs_dirent_t const*>(value);
+            entries.emplace_back(entry->name, entry->kind);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+
+    for (auto const& entry : entries)
+    {
+        if (!walk(fs_root, svn_path/entry.first, entry.second, skipped, pool, f))
+            return false;
+    }
+    return true;
+}
+
+file_prefetcher::file_prefetcher(std::string const& repo_path, unsigned num_threads)
+    : revnum(0), generation(0), walking(false), head(0), next(0),
+      window(64 * num_threads), stopping(false), plaintext(repo_path)
+{
+    // Open the repository connections here rather than on the worker
+    // threads; svn_fs initialization is not thread-safe.
+    for (unsigned i = 0; i <= num_threads; ++i)
+        workers.emplace_back(new worker(repo_path));
+
+    for (unsigned i = 0; i < num_threads; ++i)
+        threads.emplace_back([this, i]{ run(*workers[i]); });
+    threads.emplace_back([this]{ run_walker(*workers.back()); });
+}
+
+file_prefetcher::~file_prefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_available.notify_all();
+    for (auto& t : threads)
+        t.join();
+}
+
+void file_prefetcher::start(int revnum, std::vector<path> trees, std::vector<path> skipped)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++generation;
+        this->revnum = revnum;
+        this->trees = std::move(trees);
+        this->skipped = std::move(skipped);
+        walking = !this->trees.empty();
+        queue.clear();
+        positions.clear();
+        head = next = 0;
+    }
+    work_available.notify_all();
+}
+
+void file_prefetcher::cancel()
+{
+    start(revnum, std::vector<path>(), std::vector<path>());
+}
+
+std::unique_ptr<file_prefetcher::contents>
+file_prefetcher::take(path const& svn_path)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+
+    // The walk queues files in path order, so once it has gone past
+    // svn_path without queueing it, it never will
+    auto p = positions.end();
+    item_ready.wait(lock, [&]{
+        p = positions.find(svn_path.str());
+        return p != positions.end() || !walking
+            || (!queue.empty() && svn_path < queue.back().svn_path);
+    });
+    if (p == positions.end() || p->second < head)
+        return nullptr;
+
+    // Discard whatever we're passing over
+    for (; head < p->second; ++head)
+        queue[head].result.reset();
+    work_available.notify_all();
+
+    item& x = queue[head];
+    item_ready.wait(lock, [&x]{ return x.ready; });
+    ++head;
+    work_available.notify_all();
+
+    if (!x.error.empty())
+        throw std::runtime_error(
+            "reading " + x.svn_path.str() + " in r" + to_string(revnum) + ": " + x.error);
+
+    return std::move(x.result);
+}
+
+void file_prefetcher::run(worker& w)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_available.wait(lock, [this]{
+            return stopping
+                || std::max(next, head) < std::min(queue.size(), head + window);
+        });
+        if (stopping)
+            return;
+
+        next = std::max(next, head);
+        std::size_t const i = next++;
+        unsigned const generation = this->generation;
+        int const revnum = this->revnum;
+        path const svn_path = queue[i].svn_path;
+
+        lock.unlock();
+        std::unique_ptr<contents> result(new contents);
+        std::string error;
+        try
+        {
+            w.read(revnum, svn_path, *result);
+        }
+        catch(std::exception const& e)
+        {
+            error = e.what();
+        }
+        lock.lock();
+
+        // Drop the result if the queue was replaced while we worked,
+        // or if the importer has already passed this item over.
+        if (generation != this->generation || i < head)
+            continue;
+
+        queue[i].result = std::move(result);
+        queue[i].error = std::move(error);
+        queue[i].ready = true;
+        item_ready.notify_all();
+    }
+}
+
+void file_prefetcher::run_walker(worker& w)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        work_available.wait(lock, [this]{ return stopping || !trees.empty(); });
+        if (stopping)
+            return;
+
+        unsigned const generation = this->generation;
+        int const revnum = this->revnum;
+        std::vector<path> const trees = std::move(this->trees);
+        std::vector<path> const skipped = std::move(this->skipped);
+        this->trees.clear();
+        this->skipped.clear();
+
+        lock.unlock();
+        try
+        {
+            svn_fs_root_t* const fs_root = w.root(revnum);
+            AprPool scope = w.root_pool.make_subpool();
+
+            // Returns false once the queue has been replaced
+            auto enqueue = [&](path const& file_path)
+            {
+                {
+                    AprPool file_scope = scope.make_subpool();
+                    svn_fs_id_t const* id = svn::call(
+                        svn_fs_node_id, fs_root, file_path.c_str(), file_scope);
+                    svn_string_t const* node_id = svn_fs_unparse_id(id, file_scope);
+                    auto const length = svn::call(
+                        svn_fs_file_length, fs_root, file_path.c_str(), file_scope);
+                    if (plaintext.find(std::string(node_id->data, node_id->len), length))
+                        return true;
+                }
+
+                std::lock_guard<std::mutex> guard(mutex);
+                if (stopping || generation != this->generation)
+                    return false;
+
+                // If a file is reached twice, keep its first position
+                positions.emplace(file_path.str(), queue.size());
+                queue.push_back(item{file_path, false, nullptr, std::string()});
+                work_available.notify_all();
+                item_ready.notify_all();
+                return true;
+            };
+
+            for (auto const& tree : trees)
+            {
+                svn_node_kind_t const kind = svn::call(
+                    svn_fs_check_path, fs_root, tree.c_str(), scope);
+                if (!walk(fs_root, tree, kind, skipped, scope, enqueue))
+                    break;
+            }
+        }
+        catch(std::exception const&)
+        {
+            // The importer will run into the same trouble, and report
+            // it, when it reads the files we couldn't queue
+        }
+        lock.lock();
+
+        if (generation == this->generation)
+        {
+            walking = false;
+            item_ready.notify_all();
+        }
+    }
+}
@@ -0,0 +1,98 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FILE_PREFETCHER_DWA2013722_HPP
+# define FILE_PREFETCHER_DWA2013722_HPP
+
+# include "fsfs_plaintext.hpp"
+# include "path.hpp"
+# include <condition_variable>
+# include <deque>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <thread>
+# include <unordered_map>
+# include <vector>
+
+// Reads the contents of SVN files on a pool of worker threads, so
+// that FSFS delta reconstruction proceeds in parallel with the
+// importer's writes to git fast-import.  Each worker has its own
+// connection to the repository and its own APR pools, since neither
+// may be shared across threads.
+//
+// The importer names the trees of a revision that it will convert, in
+// the order in which it will later visit them, and then takes the
+// contents of their files one by one.  A thread of its own walks the
+// trees, queueing their files in the importer's order, while the
+// workers read the files already queued.  Files the repository
+// stores verbatim are not queued, since the importer copies those
+// straight from the revision files.
+//
+// Workers never run more than a fixed window ahead of the file most
+// recently taken.  Taking a file passes over (and discards) any
+// queued files before it, so files the importer decides not to write
+// don't hold up the window.
+class file_prefetcher
+{
+ public:
+    struct contents
+    {
+        std::string data;
+        bool executable;
+        std::string sha;  // The Git blob SHA of data
+    };
+
+    file_prefetcher(std::string const& repo_path, unsigned num_threads);
+    ~file_prefetcher();
+
+    // Queue the files at or beneath the given trees of SVN revision
+    // revnum, discarding anything still queued.  The directories in
+    // skipped, which must be sorted, are not entered.
+    void start(int revnum, std::vector<path> trees, std::vector<path> skipped);
+
+    // Return the contents of svn_path, waiting for the walk to reach
+    // it and a worker to read it if necessary.  Returns null if svn_path is not
+    // queued or was passed over; the caller should then read the file
+    // itself.
+    std::unique_ptr<contents> take(path const& svn_path);
+
+    // Discard everything queued
+    void cancel();
+
+ private:
+    struct worker;
+    struct item
+    {
+        path svn_path;
+        bool ready;
+        std::unique_ptr<contents> result;
+        std::string error;
+    };
+
+    void run(worker& w);
+    void run_walker(worker& w);
+
+ private:
+    std::mutex mutex;
+    std::condition_variable work_available;
+    std::condition_variable item_ready;
+
+    int revnum;
+    unsigned generation;  // incremented whenever the queue is replaced
+    std::vector<path> trees;    // waiting to be walked
+    std::vector<path> skipped;
+    bool walking;         // until every tree's files are queued
+    std::deque<item> queue;
+    std::unordered_map<std::string, std::size_t> positions;
+    std::size_t head;     // the next item the importer may take
+    std::size_t next;     // the next item a worker will read
+    std::size_t window;
+    bool stopping;
+
+    std::vector<std::unique_ptr<worker> > workers;  // the last one walks
+    fsfs_plaintext plaintext;                        // used by the walk
+    std::vector<std::thread> threads;
+};
+
+#endif // FILE_PREFETCHER_DWA2013722_HPP
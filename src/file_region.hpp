@@ -0,0 +1,75 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FILE_REGION_DWA2013803_HPP
+# define FILE_REGION_DWA2013803_HPP
+
+# include <cstdint>
+# include <memory>
+# include <stdexcept>
+# include <string>
+# include <cerrno>
+# include <cstring>
+# include <fcntl.h>
+# include <sys/mman.h>
+# include <unistd.h>
+
+// A file descriptor that is closed when the last copy goes away
+typedef std::shared_ptr<int const> shared_fd;
+
+// Opens the named file for reading, returning null on failure
+inline shared_fd open_shared_fd(std::string const& filename)
+{
+    int const fd = ::open(filename.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return shared_fd();
+    return shared_fd(new int(fd), [](int const* p) { ::close(*p); delete p; });
+}
+
+// A range of bytes in an open file
+struct file_region
+{
+    shared_fd fd;
+    std::uint64_t offset;
+    std::uint64_t size;
+};
+
+// A file_region's bytes, mapped into memory for reading
+class mapped_region
+{
+ public:
+    explicit mapped_region(file_region const& r)
+        : base(nullptr), length(0), start(nullptr)
+    {
+        if (r.size == 0)
+        {
+            start = "";
+            return;
+        }
+        std::uint64_t const page = ::sysconf(_SC_PAGESIZE);
+        std::uint64_t const aligned = r.offset - r.offset % page;
+        length = r.offset - aligned + r.size;
+        base = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, *r.fd, aligned);
+        if (base == MAP_FAILED)
+            throw std::runtime_error(std::string("mmap failed: ") + std::strerror(errno));
+        start = static_cast<char const*>(base) + (r.offset - aligned);
+    }
+
+    ~mapped_region()
+    {
+        if (base)
+            ::munmap(base, length);
+    }
+
+    mapped_region(mapped_region const&) = delete;
+    void operator=(mapped_region const&) = delete;
+
+    char const* data() const { return start; }
+
+ private:
+    void* base;
+    std::size_t length;
+    char const* start;
+};
+
+#endif // FILE_REGION_DWA2013803_HPP
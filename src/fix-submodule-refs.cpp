@@ -6,8 +6,11 @@
 #include "AST.hpp"
 #include "ruleset.hpp"
 #include "marks_file_name.hpp"
+#include "block_reader.hpp"
+#include "output_buffer.hpp"
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
+#include <boost/process.hpp>
 #include <set>
 #include <map>
 #include <fstream>
@@ -15,15 +18,36 @@
 #include <iostream>
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/range/adaptor/map.hpp>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <exception>
+#include <future>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 
 namespace fix_submodule {
 
 struct Repository
   {
+  Repository() : submodule_in_repo(nullptr) {}
+
+  // The marks of a submodule, once they have been read
+  mark_sha_map const& marks() const
+    {
+    marks_ready.get();
+    return mark2sha;
+    }
+
   std::string name;
   Repository* submodule_in_repo;
   std::string submodule_path;
   mark_sha_map mark2sha;
+  std::promise<void> marks_read;
+  std::shared_future<void> marks_ready;
   };
 
 typedef std::map<std::string, Repository> RepoStore;
@@ -32,106 +56,199 @@ typedef std::map<std::string, Repository const*> SubmoduleMap;
 struct Options
   {
   std::string rules_file;
-  std::string repo_name;
+  std::vector<std::string> repo_names;
+  std::string fixup_suffix;
+  std::string git_executable;
   };
 
 Options options;
 
-void read_marks_file(Repository& repo)
+// Reads the marks files of submodules on a few threads.  Each
+// repository's marks() waits for just its own file, so rewriting can
+// start before all of them are read.
+class marks_loader
+  {
+ public:
+  explicit marks_loader(std::vector<Repository*> const& repos)
+    : repos(repos), next(0)
+    {
+    BOOST_FOREACH(Repository* repo, repos)
+      repo->marks_ready = repo->marks_read.get_future().share();
+
+    std::size_t const num_threads = std::min<std::size_t>(
+        repos.size(), std::max(1u, std::thread::hardware_concurrency()));
+    for (std::size_t i = 0; i < num_threads; ++i)
+      threads.emplace_back([this]{ work(); });
+    }
+
+  ~marks_loader()
+    {
+    BOOST_FOREACH(std::thread& t, threads)
+      t.join();
+    }
+
+ private:
+  void work()
+    {
+    for (std::size_t i; (i = next++) < repos.size();)
+      {
+      Repository& repo = *repos[i];
+      try
+        {
+        repo.mark2sha.load(marks_file_path(repo.name));
+        repo.marks_read.set_value();
+        }
+      catch (...)
+        {
+        repo.marks_read.set_exception(std::current_exception());
+        }
+      }
+    }
+
+  std::vector<Repository*> repos;
+  std::atomic<std::size_t> next;
+  std::vector<std::thread> threads;
+  };
+
+void write_all(int fd, char const* data, std::size_t size)
   {
-  std::string marks_path = marks_file_path(repo.name);
-  std::ifstream marks(marks_path.c_str());
-  if (marks.fail())
-    throw std::runtime_error("Couldn't open marks file: " + marks_path);
-  marks.exceptions( std::ifstream::badbit );
-
-  char colon, newline;
-  std::pair<unsigned long, std::string> mark_sha;
-  while (marks >> colon >> mark_sha.first >> mark_sha.second)
+  while (size > 0)
     {
-    if (colon != ':')
-        throw std::runtime_error("Expected colon in marks file: " + marks_path);
-    marks.read(&newline, 1);
-    if (newline != '\n')
-        throw std::runtime_error("Expected newline in marks file: " + marks_path);
-
-    // Insert the mapping.  All kinds of efficiencies are possible
-    // here, but I was more interested in getting the logic right.
-    mark_sha_map::iterator where = find_sha_pos(repo.mark2sha, mark_sha.first);
-    
-    // Make sure we're not mapping the same mark twice.
-    if (where != repo.mark2sha.end() && where->first == mark_sha.first)
-        throw std::runtime_error("Duplicate mark mapping in " + marks_path);
-    
-    repo.mark2sha.insert(where, mark_sha);
+    ssize_t const n = ::write(fd, data, size);
+    if (n < 0)
+      {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error(std::string("write failed: ") + std::strerror(errno));
+      }
+    data += n;
+    size -= n;
     }
   }
 
-void transform_import_stream(
-    Repository const& super_module,
-    SubmoduleMap const& submodules
-  )
+// True iff gitlink is a mark zero-padded to 40 digits, as written by
+// svn2git --gitlink-marks, rather than a commit SHA
+bool is_padded_mark(boost::string_ref gitlink)
   {
-  std::istream& in = std::cin;
-  std::ostream& out = std::cout;
-    
-  char const submodule_prefix[] = "M 160000 ";
-  std::size_t const submodule_prefix_length = std::strlen(submodule_prefix);
-  std::size_t const sha_length = 40;
+  return gitlink.size() == 40
+    && std::all_of(gitlink.begin(), gitlink.end(), [](char c) { return c >= '0' && c <= '9'; });
+  }
+
+// Copy the fast-export stream from in_fd to out_fd, replacing the
+// marks in submodule gitlinks with the commit SHAs they stand for.
+// Gitlinks that already hold SHAs are left alone.  Only command lines
+// are scanned; data payloads are passed through wholesale.
+void transform_import_stream(int in_fd, int out_fd, SubmoduleMap const& submodules)
+  {
+  std::size_t const buffer_size = 1 << 20;
+  block_reader in(in_fd, buffer_size);
+  output_buffer out(
+      buffer_size,
+      [=](char const* data, std::size_t size) { write_all(out_fd, data, size); });
 
-  char const data_prefix[] = "data ";
-  std::size_t const data_prefix_length = std::strlen(data_prefix);
+  boost::string_ref const submodule_prefix = "M 160000 ";
+  std::size_t const sha_length = 40;
+  boost::string_ref const data_prefix = "data ";
 
-  in.exceptions( std::istream::badbit );
-  out.exceptions( std::ostream::failbit | std::ostream::badbit );
-  
-  std::string line;
-  while (getline(in, line))
+  boost::string_ref line;
+  while (in.getline(line))
     {
-    if (boost::starts_with(line, submodule_prefix))
+    if (line.starts_with(submodule_prefix)
+        && is_padded_mark(line.substr(submodule_prefix.size(), sha_length)))
       {
-      unsigned long mark = boost::lexical_cast<unsigned long>(
-          line.substr(submodule_prefix_length, sha_length));
-      std::string submodule_path = line.substr(submodule_prefix_length + sha_length + 1);
+      boost::string_ref const rest = line.substr(submodule_prefix.size());
+      unsigned long mark = boost::lexical_cast<unsigned long>(rest.substr(0, sha_length));
+      std::string submodule_path = rest.substr(sha_length + 1).to_string();
 
       SubmoduleMap::const_iterator sub_repo = submodules.find(submodule_path);
       assert(sub_repo != submodules.end());
         
-      mark_sha_map::const_iterator const mark_sha = find_sha_pos(sub_repo->second->mark2sha, mark);
-      if (mark_sha->first != mark)
+      mark_sha_map::sha_type const* const sha = sub_repo->second->marks().find(mark);
+      if (!sha)
         {
         throw std::runtime_error(
             "unmapped mark " + to_string(mark) + " in " + marks_file_path(sub_repo->second->name)
           );
         }
-      out << submodule_prefix << mark_sha->second << " " << submodule_path << "\n";
-      }
-    else
-      {
-      out << line << "\n";
+      out.put(submodule_prefix);
+      out.put(sha1::to_hex(*sha));
+      out.put(' ');
+      out.put(submodule_path);
+      out.put('\n');
+      continue;
       }
 
-    if (boost::starts_with(line, data_prefix))
+    out.put(line);
+    out.put('\n');
+
+    if (line.starts_with(data_prefix))
       {
-      std::size_t length = boost::lexical_cast<std::size_t>(
-          line.substr(data_prefix_length));
-        
-      while (length > 0)
-        {
-        char buf[2048];
-        std::size_t num_to_read = std::min(length, sizeof(buf));
-        in.read(buf, num_to_read);
-        out.write(buf, num_to_read);
-        length -= num_to_read;
-        }
+      std::size_t length = boost::lexical_cast<std::size_t>(line.substr(data_prefix.size()));
+      in.forward(length, out, out_fd);
       }
     }
+  out.flush();
+  }
+
+// A pipe whose ends aren't inherited by child processes, except as
+// the standard streams they are bound to, so that processes started
+// for other superprojects can't hold it open
+boost::process::pipe private_pipe()
+  {
+  int fds[2];
+  if (::pipe2(fds, O_CLOEXEC) != 0)
+    throw std::runtime_error(std::string("pipe failed: ") + std::strerror(errno));
+  return boost::process::pipe(fds[0], fds[1]);
+  }
+
+// Pipe "git fast-export --all" of the superproject through
+// transform_import_stream into "git fast-import" of the repository
+// whose name is the superproject's plus options.fixup_suffix
+void fix_repository(Repository const& super_module, SubmoduleMap const& submodules)
+  {
+  namespace process = boost::process;
+  namespace iostreams = boost::iostreams;
+  using namespace process::initializers;
+
+  std::string const& git = options.git_executable;
+  process::pipe const exported = private_pipe();
+  process::pipe const imported = private_pipe();
+  iostreams::file_descriptor_source from_export(exported.source, iostreams::close_handle);
+  iostreams::file_descriptor_sink to_import(imported.sink, iostreams::close_handle);
+
+  std::vector<std::string> const export_args = { git, "fast-export", "--all" };
+  process::child exporter = process::execute(
+      run_exe(git),
+      set_args(export_args),
+      start_in_dir(super_module.name),
+      bind_stdout(iostreams::file_descriptor_sink(exported.sink, iostreams::close_handle)),
+      throw_on_error());
+
+  std::vector<std::string> const import_args = { git, "fast-import", "--quiet", "--force" };
+  process::child importer = process::execute(
+      run_exe(git),
+      set_args(import_args),
+      start_in_dir(super_module.name + options.fixup_suffix),
+      bind_stdin(iostreams::file_descriptor_source(imported.source, iostreams::close_handle)),
+      throw_on_error());
+
+  transform_import_stream(exported.source, imported.sink, submodules);
+  to_import.close();
+
+  if (process::wait_for_exit(exporter) != 0)
+    throw std::runtime_error("git fast-export failed in " + super_module.name);
+  if (process::wait_for_exit(importer) != 0)
+    throw std::runtime_error(
+        "git fast-import failed in " + super_module.name + options.fixup_suffix);
   }
 
 void run()
   {
   using boost2git::AST;
   
+  if (options.repo_names.size() > 1 && options.fixup_suffix.empty())
+    throw std::runtime_error("rewriting more than one repository requires --fixup-suffix");
+
   AST const ast = parse_rules_file(options.rules_file);
   
   RepoStore repo_store;
@@ -147,22 +264,63 @@ void run()
       }
     }
 
-  // Verify that the specified repository actually exists in the map
-  RepoStore::iterator const p = repo_store.find(options.repo_name);
-  if (p == repo_store.end())
-      throw std::runtime_error("repository " + options.repo_name + " not found in ruleset");
-
-  SubmoduleMap submodules;
-  // Read all relevant marks files
-  BOOST_FOREACH(Repository& repo, repo_store | boost::adaptors::map_values)
+  // Find each superproject's submodules, whose marks files will be read
+  std::set<std::string> const repo_names(
+      options.repo_names.begin(), options.repo_names.end());
+  std::vector<std::pair<Repository const*, SubmoduleMap> > super_modules;
+  std::vector<Repository*> submodule_repos;
+  BOOST_FOREACH(std::string const& repo_name, repo_names)
     {
-    if (repo.submodule_in_repo == &p->second)
+    // Verify that the specified repository actually exists in the map
+    RepoStore::iterator const p = repo_store.find(repo_name);
+    if (p == repo_store.end())
+        throw std::runtime_error("repository " + repo_name + " not found in ruleset");
+
+    SubmoduleMap submodules;
+    BOOST_FOREACH(Repository& repo, repo_store | boost::adaptors::map_values)
       {
-        read_marks_file(repo);
-        submodules[repo.submodule_path] = &repo;
+      if (repo.submodule_in_repo == &p->second)
+        {
+          submodules[repo.submodule_path] = &repo;
+          submodule_repos.push_back(&repo);
+        }
       }
+    super_modules.push_back(std::make_pair(&p->second, submodules));
+    }
+
+  marks_loader loader(submodule_repos);
+
+  if (options.fixup_suffix.empty())
+    {
+    transform_import_stream(STDIN_FILENO, STDOUT_FILENO, super_modules.front().second);
+    return;
+    }
+
+  // Rewrite the superprojects side by side
+  std::vector<std::exception_ptr> errors(super_modules.size());
+  std::vector<std::thread> fixers;
+  for (std::size_t i = 0; i < super_modules.size(); ++i)
+    {
+    fixers.emplace_back(
+        [&, i]
+        {
+        try
+          {
+          fix_repository(*super_modules[i].first, super_modules[i].second);
+          }
+        catch (...)
+          {
+          errors[i] = std::current_exception();
+          }
+        });
+    }
+  BOOST_FOREACH(std::thread& t, fixers)
+    t.join();
+  BOOST_FOREACH(std::exception_ptr const& e, errors)
+    {
+    if (e)
+      std::rethrow_exception(e);
     }
-  transform_import_stream(p->second, submodules);
   }
 } // namespace fix_submodule
 
@@ -175,8 +333,14 @@ int main(int argc, char **argv)
     ("help,h", "produce help message")
     ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(),
       "file with the conversion rules")
-    ("repo-name", po::value(&options.repo_name)->value_name("IDENTIFIER")->required(),
-      "name of the repository to rewrite")
+    ("repo-name", po::value(&options.repo_names)->value_name("IDENTIFIER")->required()->composing(),
+      "name of the superproject repository to rewrite; may be repeated with --fixup-suffix")
+    ("fixup-suffix", po::value(&options.fixup_suffix)->value_name("SUFFIX"),
+      "rather than rewriting the output of git fast-export from stdin to stdout, "
+      "export each superproject and import the result into the existing repository "
+      "named by appending SUFFIX to the superproject's name")
+    ("git", po::value(&options.git_executable)->value_name("PATH"),
+      "Git executable to use with --fixup-suffix")
     ;
   po::variables_map variables;
   store(po::command_line_parser(argc, argv)
@@ -189,6 +353,9 @@ int main(int argc, char **argv)
     return 0;
     }
 
+  if (options.git_executable.empty())
+    options.git_executable = boost::process::search_path("git");
+
   try
     {
     fix_submodule::run();
@@ -0,0 +1,178 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "fsfs_plaintext.hpp"
+#include "to_string.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// How many revision and pack files to keep open
+static std::size_t const open_files = 64;
+
+// Node-revision headers longer than this are left to libsvn
+static std::size_t const max_header_size = 16 * 1024;
+
+fsfs_plaintext::fsfs_plaintext(std::string const& repo_path)
+    : revs_dir(repo_path + "/db/revs"), usable(false), shard_size(0), files(open_files)
+{
+    // The first line of db/format holds the format number; later
+    // ones, the options.  Formats 1-6 address everything by offset.
+    std::ifstream format_file(repo_path + "/db/format");
+    int format = 0;
+    if (!(format_file >> format) || format < 1 || format > 6)
+        return;
+
+    std::string line;
+    while (std::getline(format_file, line))
+    {
+        std::istringstream option(line);
+        std::string name, value;
+        option >> name >> value;
+        if (name == "layout" && value == "sharded")
+            option >> shard_size;
+    }
+    usable = true;
+}
+
+// Read exactly n bytes at offset, or fail
+static bool read_at(int fd, std::uint64_t offset, char* buffer, std::size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t const got = ::pread(fd, buffer, n, offset);
+        if (got <= 0)
+            return false;
+        buffer += got;
+        offset += got;
+        n -= got;
+    }
+    return true;
+}
+
+boost::optional<file_region>
+fsfs_plaintext::find(std::string const& node_id, std::uint64_t size)
+{
+    boost::optional<file_region> none;
+    if (!usable)
+        return none;
+
+    // A committed node-revision id ends in ".r<revision>/<offset>"
+    std::size_t const r = node_id.rfind(".r");
+    if (r == std::string::npos)
+        return none;
+    long revnum;
+    unsigned long long offset;
+    char slash;
+    std::istringstream location(node_id.substr(r + 2));
+    if (!(location >> revnum >> slash >> offset) || slash != '/' || !location.eof())
+        return none;
+
+    shared_fd fd;
+    std::uint64_t start;
+    if (!locate_revision(revnum, fd, start))
+        return none;
+
+    // Read the node-revision's header, which ends with an empty line
+    // and begins by identifying the node-revision
+    std::string header(max_header_size, '\0');
+    ssize_t const got = ::pread(*fd, &header[0], header.size(), start + offset);
+    if (got <= 0)
+        return none;
+    header.resize(got);
+    std::size_t const end = header.find("\n\n");
+    if (end == std::string::npos)
+        return none;
+    header.resize(end + 1);
+    if (!boost::starts_with(header, "id: " + node_id + "\n"))
+        return none;
+
+    // Find "text: <revision> <offset> <size> <expanded size> ..."
+    std::istringstream lines(header);
+    std::string line;
+    bool is_file = false;
+    long text_revnum = -1;
+    unsigned long long text_offset = 0, text_size = 0, expanded_size = 0;
+    while (std::getline(lines, line))
+    {
+        if (line == "type: file")
+            is_file = true;
+        else if (boost::starts_with(line, "text: "))
+        {
+            std::istringstream text(line.substr(6));
+            if (!(text >> text_revnum >> text_offset >> text_size >> expanded_size))
+                return none;
+        }
+    }
+    if (!is_file || text_revnum < 0 || text_size != size
+        || (expanded_size != 0 && expanded_size != size))
+    {
+        return none;
+    }
+
+    // The representation must be stored verbatim
+    if (!locate_revision(text_revnum, fd, start))
+        return none;
+    static char const plain[] = "PLAIN\n";
+    char rep_header[sizeof(plain) - 1];
+    if (!read_at(*fd, start + text_offset, rep_header, sizeof(rep_header))
+        || !std::equal(rep_header, rep_header + sizeof(rep_header), plain))
+    {
+        return none;
+    }
+
+    file_region result = { fd, start + text_offset + sizeof(rep_header), size };
+    return result;
+}
+
+bool fsfs_plaintext::locate_revision(long revnum, shared_fd& fd, std::uint64_t& start)
+{
+    std::string const shard_dir
+        = shard_size ? revs_dir + "/" + to_string(revnum / shard_size) : revs_dir;
+
+    fd = open(shard_dir + "/" + to_string(revnum));
+    if (fd)
+    {
+        start = 0;
+        return true;
+    }
+
+    // Otherwise it may have been packed with the rest of its shard
+    if (shard_size == 0)
+        return false;
+    auto const* offsets = manifest(revnum / shard_size);
+    if (!offsets || std::size_t(revnum % shard_size) >= offsets->size())
+        return false;
+    fd = open(shard_dir + ".pack/pack");
+    start = (*offsets)[revnum % shard_size];
+    return bool(fd);
+}
+
+shared_fd fsfs_plaintext::open(std::string const& filename)
+{
+    if (auto const* cached = files.find(filename))
+        return *cached;
+
+    // Remember failures too.  Revisions are committed before we read
+    // them, so a missing revision file won't turn up later.
+    return files.insert(filename, open_shared_fd(filename));
+}
+
+// The starting offset of each revision in a packed shard
+std::vector<std::uint64_t> const* fsfs_plaintext::manifest(long shard)
+{
+    auto p = manifests.find(shard);
+    if (p == manifests.end())
+    {
+        std::vector<std::uint64_t> offsets;
+        std::ifstream manifest_file(revs_dir + "/" + to_string(shard) + ".pack/manifest");
+        for (std::uint64_t offset; manifest_file >> offset;)
+            offsets.push_back(offset);
+        p = manifests.emplace(shard, std::move(offsets)).first;
+    }
+    return p->second.empty() ? nullptr : &p->second;
+}
@@ -0,0 +1,46 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef FSFS_PLAINTEXT_DWA2013803_HPP
+# define FSFS_PLAINTEXT_DWA2013803_HPP
+
+# include "file_region.hpp"
+# include "lru_cache.hpp"
+# include <boost/optional.hpp>
+# include <cstdint>
+# include <map>
+# include <string>
+# include <vector>
+
+// Finds file contents that an FSFS repository stores verbatim (as a
+// "PLAIN" representation) in its revision files, so they can be
+// copied from there without going through libsvn.  Only the
+// physically addressed formats written by SVN 1.8 and earlier are
+// understood; for anything else, find() comes up empty and the
+// contents must be read through libsvn as usual.
+class fsfs_plaintext
+{
+ public:
+    explicit fsfs_plaintext(std::string const& repo_path);
+
+    // Where the contents of the file with the given (unparsed)
+    // node-revision id are stored verbatim, if they are and are size
+    // bytes long
+    boost::optional<file_region> find(std::string const& node_id, std::uint64_t size);
+
+ private:
+    // The file holding revnum, and where in it the revision starts
+    bool locate_revision(long revnum, shared_fd& fd, std::uint64_t& start);
+    shared_fd open(std::string const& filename);
+    std::vector<std::uint64_t> const* manifest(long shard);
+
+ private:
+    std::string revs_dir;
+    bool usable;
+    long shard_size;                 // 0 if not sharded
+
+    lru_cache<std::string, shared_fd> files;
+    std::map<long, std::vector<std::uint64_t> > manifests; // By shard
+};
+
+#endif // FSFS_PLAINTEXT_DWA2013803_HPP
@@ -7,6 +7,7 @@
 #include "path.hpp"
 #include "options.hpp"
 #include "marks_file_name.hpp"
+#include "stats.hpp"
 
 #include <boost/iostreams/device/file_descriptor.hpp>
 #include <numeric>
@@ -15,11 +16,18 @@ using namespace boost::process::initializers;
 using namespace boost::process;
 namespace iostreams = boost::iostreams;
 
+// How much may be queued for each fast-import process before writers
+// have to wait for it to catch up
+static std::size_t const queue_capacity = 8 * 1024 * 1024;
+
+// How much of the command stream is collected before it is passed on
+static std::size_t const buffer_size = 64 * 1024;
+
 git_fast_import::git_fast_import(std::string const& git_dir)
     : inp(boost::process::create_pipe()),
       outp(boost::process::create_pipe()),
       process(
-          options.dry_run ? boost::optional<boost::process::child>()
+          options.dry_run || options.native_packs ? boost::optional<boost::process::child>()
           : boost::process::execute(
               run_exe(git_executable()),
               set_env(std::vector<std::string>({"GIT_DIR="+git_dir})),
@@ -31,9 +39,28 @@ git_fast_import::git_fast_import(std::string const& git_dir)
               close_fd(inp.source),
 #endif
               throw_on_error())),
-      cin(iostreams::file_descriptor_sink(outp.sink, iostreams::close_handle)),
-      cout(iostreams::file_descriptor_source(inp.source, iostreams::close_handle))
+      native(
+          options.native_packs && !options.dry_run ? new native_fast_import(git_dir) : nullptr),
+      writer(
+          native ? boost::optional<pipe_writer>()
+          : pipe_writer(outp.sink, queue_capacity)),
+      cin(buffer_size,
+          [this](char const* s, std::size_t n)
+          {
+              if (native)
+                  native->write(s, n);
+              else
+                  writer->write(s, n);
+          }),
+      cout(iostreams::file_descriptor_source(inp.source, iostreams::close_handle)),
+      ls_wait(0)
 {
+    // With no process to talk to, only cout's end of the pipes is used
+    if (native)
+    {
+        for (auto handle : {inp.sink, outp.source, outp.sink})
+            iostreams::file_descriptor unused(handle, iostreams::close_handle);
+    }
 }
 
 git_fast_import::~git_fast_import()
@@ -46,14 +73,40 @@ git_fast_import::~git_fast_import()
         wait_for_exit(*process);
 }
 
+void git_fast_import::close()
+{
+    // This is called from destructors, so don't let the final flush
+    // throw
+    try
+    {
+        cin.flush();
+        if (native)
+            native->close();
+        else
+            writer->close();
+    }
+    catch(std::exception const& e)
+    {
+        Log::error() << "Failed to finish writing to " << (native ? "pack" : "git fast-import")
+                     << ": " << e.what() << std::endl;
+    }
+}
+
 std::vector<std::string> 
 git_fast_import::arg_vector(std::string const& git_dir)
 {
-    return 
+    std::vector<std::string> args
     { 
         git_executable(), "fast-import", "--quiet", "--force", 
         "--export-marks=" + marks_file_path(git_dir) 
     };
+
+    // An incremental conversion continues from the marks exported
+    // by the previous run
+    if (!options.state_file.empty())
+        args.push_back("--import-marks-if-exists=" + marks_file_path(git_dir));
+
+    return args;
 }
 
 git_fast_import& git_fast_import::write_raw(char const* data, std::size_t nbytes)
@@ -72,6 +125,28 @@ git_fast_import& git_fast_import::write_raw(char const* data, std::size_t nbytes
     return *this;
 }
 
+void git_fast_import::put(path const& p)
+{
+    cin.put(p.str());
+}
+
+git_fast_import& git_fast_import::write_region(file_region const& region, char const* data)
+{
+    if (options.dry_run)
+        return *this;
+
+    if (native)
+    {
+        cin.write(data, region.size);
+    }
+    else
+    {
+        cin.flush();
+        writer->write_region(region);
+    }
+    return *this;
+}
+
 // Just writes the header.  
 git_fast_import& git_fast_import::data_hdr(std::size_t size)
 {
@@ -103,7 +178,13 @@ git_fast_import& git_fast_import::filedelete(path const& p)
 
 git_fast_import& git_fast_import::filemodify_hdr(path const& p, unsigned long mode)
 {
-    return *this << "M " << std::oct << mode << std::dec << " inline " << p << LF;
+    return *this << "M " << octal{mode} << " inline " << p << LF;
+}
+
+git_fast_import& git_fast_import::filemodify(
+    path const& p, unsigned long mode, std::string const& sha)
+{
+    return *this << "M " << octal{mode} << " " << sha << " " << p << LF;
 }
 
 git_fast_import& git_fast_import::checkpoint()
@@ -114,16 +195,37 @@ git_fast_import& git_fast_import::checkpoint()
 void git_fast_import::send_ls(std::string const& dataref_opt_path)
 {
     *this << "ls " << dataref_opt_path << LF;
-    cin << std::flush;
+    cin.flush();
+}
+
+void git_fast_import::send_get_mark(std::size_t mark)
+{
+    *this << "get-mark :" << mark << LF;
+    cin.flush();
 }
 
 std::string git_fast_import::readline()
 {
+    if (native)
+        return native->readline();
+
+    double const start = stats::wall_clock();
     std::string result;
     std::getline(cout, result);
+    ls_wait += stats::wall_clock() - start;
     return result;
 }
 
+std::uint64_t git_fast_import::bytes_written() const
+{
+    return native ? native->bytes_written() : writer->bytes_written();
+}
+
+double git_fast_import::write_blocked_seconds() const
+{
+    return native ? native->seconds_busy() : writer->seconds_blocked();
+}
+
 git_fast_import& git_fast_import::reset(std::string const& ref_name, int mark = -1)
 {
     *this << "reset " << ref_name << LF;
@@ -6,10 +6,15 @@
 
 # include "log.hpp"
 # include "options.hpp"
+# include "output_buffer.hpp"
+# include "pipe_writer.hpp"
+# include "native_fast_import.hpp"
 
 # include <boost/process.hpp>
 # include <boost/iostreams/device/file_descriptor.hpp>
 # include <boost/iostreams/stream.hpp>
+# include <memory>
+# include <type_traits>
 # include <vector>
 # include <string>
 
@@ -18,18 +23,31 @@
 
 struct path;
 
-// I/O manipulator that sends a linefeed character with no translation
-inline std::ostream& LF (std::ostream& stream)
+// Ends a line of the command stream
+struct line_feed {};
+line_feed const LF = {};
+
+inline std::ostream& operator<<(std::ostream& os, line_feed)
 {
-    stream.rdbuf()->sputc('\n');
-    return stream;
+    return os << '\n';
+}
+
+// Writes a number in octal, as file modes are
+struct octal
+{
+    unsigned long value;
+};
+
+inline std::ostream& operator<<(std::ostream& os, octal n)
+{
+    return os << std::oct << n.value << std::dec;
 }
 
 struct git_fast_import
 {
     git_fast_import(std::string const& repo_dir);
     ~git_fast_import();
-    void close() { cin.close(); }
+    void close();
 
     template <class T>
     git_fast_import& operator<<(T const& x) 
@@ -37,7 +55,7 @@ struct git_fast_import
         if (Log::get_level() >= Log::Trace)
             std::cerr << x << std::flush;
         if (!options.dry_run)
-            this->cin << x; 
+            put(x); 
         return *this;
     }
 
@@ -54,8 +72,16 @@ struct git_fast_import
     
     git_fast_import& filemodify_hdr(path const& p, unsigned long mode = 0100644);
 
+    // Refers to a blob that git fast-import already has by its SHA
+    git_fast_import& filemodify(path const& p, unsigned long mode, std::string const& sha);
+
     git_fast_import& write_raw(char const* data, std::size_t nbytes);
 
+    // Like write_raw(data, region.size), where data holds the bytes of
+    // region.  Sent to a fast-import process, they go straight from
+    // the file into its pipe.
+    git_fast_import& write_region(file_region const& region, char const* data);
+
     // Just writes the header for the 'data' command; you can write
     // the actual data directly to the stream.
     git_fast_import& data_hdr(std::size_t size);
@@ -64,20 +90,55 @@ struct git_fast_import
     git_fast_import& reset(std::string const& ref_name, int mark);
 
     void send_ls(std::string const& dataref_opt_path);
+
+    // Ask for the SHA of the object with the given mark.  Ends any
+    // commit in progress.
+    void send_get_mark(std::size_t mark);
     std::string readline();
 
+    // For the statistics
+    std::uint64_t bytes_written() const;
+    double write_blocked_seconds() const;
+    double ls_wait_seconds() const { return ls_wait; }
+
  private:
     static std::vector<std::string> arg_vector(std::string const& git_dir);
 
+    // Format the pieces of commands into the buffer
+    void put(char c) { cin.put(c); }
+    void put(line_feed) { cin.put('\n'); }
+    void put(octal n) { cin.put_unsigned(n.value, 8); }
+    void put(char const* s) { cin.put(s); }
+    void put(std::string const& s) { cin.put(s); }
+    void put(path const& p);
+
+    template <class T>
+    typename std::enable_if<std::is_integral<T>::value>::type put(T n)
+    {
+        if (std::is_signed<T>::value && n < 0)
+        {
+            cin.put('-');
+            cin.put_unsigned(0 - static_cast<std::uintmax_t>(n));
+        }
+        else
+        {
+            cin.put_unsigned(n);
+        }
+    }
+
     boost::process::pipe inp;
     boost::process::pipe outp;
     boost::optional<boost::process::child> process;
-    boost::iostreams::stream<
-        boost::iostreams::file_descriptor_sink
-    > cin;
+    // Used instead of the process with --native-packs
+    std::unique_ptr<native_fast_import> native;
+    boost::optional<pipe_writer> writer;
+    // Feeds either the process, on a separate thread so that a busy
+    // fast-import process doesn't hold up the others, or native
+    output_buffer cin;
     boost::iostreams::stream<
         boost::iostreams::file_descriptor_source
     > cout;
+    double ls_wait;
 };
 
 #endif // GIT_FAST_IMPORT_DWA2013614_HPP
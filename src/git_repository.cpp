@@ -7,22 +7,31 @@
 #include "log.hpp"
 #include "flat_set_union.hpp"
 #include "to_string.hpp"
+#include "sha1.hpp"
 
 #include <boost/filesystem.hpp>
 #include <boost/process.hpp>
 #include <boost/range/adaptor/filtered.hpp>
+#include <algorithm>
 #include <array>
 #include <boost/range/adaptor/map.hpp>
 #include <iomanip>
+#include <istream>
+#include <ostream>
 
 git_repository::git_repository(std::string const& git_dir)
     : git_dir(git_dir),
       created(ensure_existence(git_dir)),
       fast_import_(git_dir),
       super_module(nullptr),
+      has_submodules(false),
+      blobs(std::max(options.blob_cache_size, 1)),
       last_mark(0),
       current_ref(nullptr),
-      prepared_to_close_commit(false)
+      prepared_to_close_commit(false),
+      tree_comparison(tree_index::unknown),
+      ls_previous_tree(false),
+      get_commit_sha(false)
 {
 }
 
@@ -61,6 +70,7 @@ void git_repository::set_super_module(
         }
         this->super_module = super_module;
         this->submodule_path = submodule_path;
+        super_module->has_submodules = true;
     }
 }
 
@@ -82,14 +92,12 @@ void git_repository::prepare_to_close_commit()
 
     for (auto sr : subrefs)
     {
-        assert(!sr->marks.empty());
-        std::stringstream sha_prep;
-        sha_prep << std::setfill('0') << std::setw(40) 
-                 << std::prev(sr->marks.end())->second;
+        std::string const sha = gitlink_sha(sr);
         fast_import() 
             << "M 160000 "
-            << sha_prep.str()
+            << sha
             << " " << sr->repo->submodule_path << LF;
+        record_file(sr->repo->submodule_path, 0160000, sha);
     }
 
     if (!subrefs.empty())
@@ -109,24 +117,85 @@ void git_repository::prepare_to_close_commit()
         }
         fast_import().filemodify_hdr(".gitmodules");
         fast_import().data(content.str().data(), content.str().size());
+        record_file(
+            ".gitmodules", 0100644, git_blob_sha(content.str().data(), content.str().size()));
     }
     
     if (current_ref->gitattributes_outdated)
     {
         fast_import().filemodify_hdr(".gitattributes");
         fast_import().data(options.gitattributes.data(), options.gitattributes.size());
+        record_file(
+            ".gitattributes", 0100644, 
+            git_blob_sha(options.gitattributes.data(), options.gitattributes.size()));
         current_ref->gitattributes_outdated = false;
     }
 
-    // Send a fast-import "ls" command to the changed repository now;
-    // responses will be read in a separate close_commit() pass over
-    // all changed repos.  Hopefully this will prevent us from
-    // blocking for each repo when multiple repositories are changed
-    // in a single SVN revision.
-    fast_import().send_ls("\"\"");
+    // If we've kept track of what's in the tree, we may not need to
+    // ask fast-import whether it changed.
+    tree_comparison = options.track_trees 
+        ? compare(tree_at_open, current_ref->tree) : tree_index::unknown;
+
+    if (tree_comparison == tree_index::unknown)
+    {
+        // The SHA of the previous tree isn't known if we last decided
+        // locally that it changed
+        ls_previous_tree = current_ref->head_tree_sha.empty() && current_ref->marks.size() >= 2;
+        if (ls_previous_tree)
+            fast_import().send_ls(":" + to_string(std::prev(current_ref->marks.end(), 2)->second) + " \"\"");
+
+        // Send a fast-import "ls" command to the changed repository now;
+        // responses will be read in a separate close_commit() pass over
+        // all changed repos.  Hopefully this will prevent us from
+        // blocking for each repo when multiple repositories are changed
+        // in a single SVN revision.
+        fast_import().send_ls("\"\"");
+    }
+
+    // A submodule's super-module needs the SHA of this commit for its
+    // gitlink.  Asking for it ends the commit, so it comes last.
+    get_commit_sha = super_module && !options.gitlink_marks && !options.dry_run;
+    if (get_commit_sha)
+        fast_import().send_get_mark(std::prev(current_ref->marks.end())->second);
+
     prepared_to_close_commit = true;
 }
 
+// What to write as the gitlink for the given submodule ref: the SHA
+// of its latest commit, or with options.gitlink_marks, the commit's
+// mark zero-padded to look like one
+std::string git_repository::gitlink_sha(ref const* submodule_ref) const
+{
+    assert(!submodule_ref->marks.empty());
+    if (options.gitlink_marks || options.dry_run)
+    {
+        std::stringstream sha_prep;
+        sha_prep << std::setfill('0') << std::setw(40) 
+                 << std::prev(submodule_ref->marks.end())->second;
+        return sha_prep.str();
+    }
+
+    if (submodule_ref->head_commit_sha.empty())
+    {
+        throw std::runtime_error(
+            "no commit SHA known for ref " + submodule_ref->name + " of submodule "
+            + submodule_ref->repo->name() + "; state files written without one need --gitlink-marks");
+    }
+    return submodule_ref->head_commit_sha;
+}
+
+// Extract the SHA from fast-import's response to "ls"
+static std::string ls_response_sha(std::string const& response, std::string const& ref_name)
+{
+    if (response.size() < 41)
+    {
+        Log::error() << "Unrecognized response \"" << response << "\" from ls in ref " 
+                     << ref_name << std::endl;
+        return std::string();
+    }
+    return response.substr(response.size() - 41, response.size() - 1);
+}
+
 // Close the current ref's commit.  Return true iff there are no more
 // modified refs
 bool git_repository::close_commit()
@@ -145,20 +214,30 @@ bool git_repository::close_commit()
                  << " closing commit in ref " << current_ref->name << std::endl;
 
     std::string new_sha;
-    if (!options.dry_run)
+    bool tree_unchanged = tree_comparison == tree_index::same;
+    if (tree_comparison == tree_index::unknown && !options.dry_run)
     {
-        // Read the response to the git-fast-import "ls" command sent earlier
-        std::string response = fast_import().readline();
-    
-        if (response.size() < 41)
-            Log::error() << "Unrecognized response \"" << response << "\" from ls in ref " 
-                         << current_ref->name << std::endl;
-        else
-            new_sha = response.substr(response.size() - 41, response.size() - 1);
+        // Read the responses to the git-fast-import "ls" commands sent earlier
+        if (ls_previous_tree)
+            current_ref->head_tree_sha = ls_response_sha(fast_import().readline(), current_ref->name);
+        new_sha = ls_response_sha(fast_import().readline(), current_ref->name);
+        tree_unchanged = new_sha == current_ref->head_tree_sha;
+    }
+
+    std::string commit_sha;
+    if (get_commit_sha)
+    {
+        commit_sha = fast_import().readline();
+        if (commit_sha.size() != 40)
+        {
+            throw std::runtime_error(
+                "Unrecognized response \"" + commit_sha + "\" from get-mark in repository "
+                + git_dir + ", ref " + current_ref->name);
+        }
     }
 
     // Dispose of the commit if it didn't change anything in the tree
-    if (!options.dry_run && new_sha == current_ref->head_tree_sha) 
+    if (tree_unchanged) 
     {
         Log::trace() << "Tree unchanged; resetting ref" << std::endl;
         assert(current_ref->marks.size() >= 2);
@@ -171,6 +250,8 @@ bool git_repository::close_commit()
     else
     {
         current_ref->head_tree_sha = std::move(new_sha);
+        if (get_commit_sha)
+            current_ref->head_commit_sha = std::move(commit_sha);
         if (auto s = current_ref->super_module_ref)
         {
             s->submodule_refs_written += 1;
@@ -189,6 +270,7 @@ bool git_repository::close_commit()
     modified_refs.erase(current_ref);
     current_ref = nullptr;
     prepared_to_close_commit = false;
+    get_commit_sha = false;
     Log::trace() << modified_refs.size() << " modified refs remaining." << std::endl;
     return modified_refs.empty();
 }
@@ -242,13 +324,27 @@ git_repository::ref* git_repository::open_commit(svn::revision const& rev)
     fast_import().commit(
         current_ref->name, mark, rev.author, rev.epoch, log_message);
 
+    // fast-import doesn't know about refs written by a previous run,
+    // so tell it explicitly where this one's history continues.
+    if (current_ref->resumed)
+    {
+        assert(current_ref->marks.size() >= 2);
+        fast_import() << "from :" << std::prev(current_ref->marks.end(), 2)->second << LF;
+        current_ref->resumed = false;
+    }
+
     // Write any merges required in this ref
     write_merges();
 
+    if (options.track_trees)
+        tree_at_open = current_ref->tree;
+
     // Do any deletions required in this ref
     for (auto& p : current_ref->pending_deletions)
     {
         fast_import().filedelete(p);
+        if (options.track_trees)
+            current_ref->tree.remove(p);
 
         // Make sure we rewrite the refs of all submodules caught by
         // this delete.  The submodule repositories themselves don't
@@ -265,6 +361,29 @@ git_repository::ref* git_repository::open_commit(svn::revision const& rev)
     return current_ref;
 }
 
+void git_repository::record_file(
+    path const& git_path, unsigned long mode, std::string const& sha)
+{
+    assert(current_ref);
+    if (options.track_trees)
+        current_ref->tree.set_file(git_path, mode, sha);
+}
+
+void git_repository::record_tree_copy(
+    path const& git_path, std::string const& sha,
+    ref const* src_ref, std::size_t src_mark, path const& src_git_path)
+{
+    assert(current_ref);
+    if (!options.track_trees)
+        return;
+
+    // We only know the source ref's latest tree
+    if (src_ref != current_ref && std::prev(src_ref->marks.end())->second == src_mark)
+        current_ref->tree.copy_tree(git_path, sha, src_ref->tree, src_git_path);
+    else
+        current_ref->tree.set_opaque_tree(git_path, sha);
+}
+
 void git_repository::record_ancestor(
     ref* descendant, std::string const& src_ref_name, std::size_t revnum)
 {
@@ -309,3 +428,91 @@ git_repository::ref* git_repository::modify_ref(std::string const& name, bool al
     return r;
 }
 
+
+void git_repository::save_state(std::ostream& os) const
+{
+    os << "repository " << git_dir << " " << last_mark << "\n";
+    for (auto const& r : refs | boost::adaptors::map_values)
+    {
+        os << "ref " << r.name
+           << " " << (r.head_tree_sha.empty() ? "-" : r.head_tree_sha)
+           << " " << r.gitattributes_outdated << "\n";
+
+        if (!r.head_commit_sha.empty())
+            os << "commit " << r.head_commit_sha << "\n";
+
+        for (auto const& rev_mark : r.marks)
+            os << "mark " << rev_mark.first << " " << rev_mark.second << "\n";
+
+        for (auto const& kv : r.merged_revisions)
+            os << "merged " << kv.first->name << " " << kv.second << "\n";
+
+        for (auto sr : r.submodule_refs)
+            os << "submodule " << sr->repo->name() << " " << sr->name << "\n";
+    }
+    os << "end\n";
+}
+
+void git_repository::load_state(
+    std::istream& is, int last_mark,
+    std::function<git_repository*(std::string const&)> const& find_repo)
+{
+    this->last_mark = last_mark;
+
+    ref* r = nullptr;
+    std::string line;
+    while (std::getline(is, line) && line != "end")
+    {
+        std::istringstream record(line);
+        std::string kind;
+        record >> kind;
+
+        if (kind == "ref")
+        {
+            std::string name, sha;
+            bool gitattributes_outdated;
+            record >> name >> sha >> gitattributes_outdated;
+            r = demand_ref(name);
+            r->head_tree_sha = sha == "-" ? std::string() : sha;
+            r->tree.forget();
+            r->gitattributes_outdated = gitattributes_outdated;
+        }
+        else if (kind == "commit" && r)
+        {
+            record >> r->head_commit_sha;
+        }
+        else if (kind == "mark" && r)
+        {
+            std::size_t revnum, mark;
+            record >> revnum >> mark;
+            r->marks[revnum] = mark;
+            r->resumed = true;
+        }
+        else if (kind == "merged" && r)
+        {
+            std::string src_ref_name;
+            std::size_t revnum;
+            record >> src_ref_name >> revnum;
+            r->merged_revisions[demand_ref(src_ref_name)] = revnum;
+        }
+        else if (kind == "submodule" && r)
+        {
+            std::string repo_name, ref_name;
+            record >> repo_name >> ref_name;
+            git_repository* sub = find_repo(repo_name);
+            if (sub == nullptr)
+                throw std::runtime_error(
+                    "state file names unknown submodule repository " + repo_name);
+            r->submodule_refs.insert(sub->demand_ref(ref_name));
+        }
+        else
+        {
+            throw std::runtime_error(
+                "unrecognized line in state of repository " + git_dir + ": " + line);
+        }
+
+        if (record.fail())
+            throw std::runtime_error(
+                "malformed line in state of repository " + git_dir + ": " + line);
+    }
+}
@@ -5,12 +5,16 @@
 # define GIT_REPOSITORY_DWA2013614_HPP
 
 # include "git_fast_import.hpp"
+# include "lru_cache.hpp"
 # include "path_set.hpp"
 # include "path.hpp"
 # include "svn.hpp"
+# include "tree_index.hpp"
 # include <boost/container/flat_map.hpp>
 # include <boost/container/flat_set.hpp>
 # include <unordered_map>
+# include <functional>
+# include <iosfwd>
 
 struct git_repository
 {
@@ -29,6 +33,7 @@ struct git_repository
             )
             , submodule_refs_written(0)
             , gitattributes_outdated(!options.gitattributes.empty())
+            , resumed(false)
         {}
 
         typedef boost::container::flat_map<std::size_t, std::size_t> rev_mark_map;
@@ -49,6 +54,8 @@ struct git_repository
         ref* super_module_ref;
         rev_mark_map marks;
         merge_map merged_revisions;
+        // Emptied as each commit is written, but it keeps its
+        // capacity, so it rarely allocates after the first few
         merge_map pending_merges;
         path_set pending_deletions;
         // Submodule refs included in the previous commit
@@ -62,7 +69,15 @@ struct git_repository
         // super-module where it lives is being rewritten.
         boost::container::flat_set<ref const*> stale_submodule_refs;
         std::string head_tree_sha;
+        // The SHA of the commit at the last mark, for the gitlinks
+        // in a super-module
+        std::string head_commit_sha;
         bool gitattributes_outdated;
+        // True iff this ref's history was loaded from a previous run
+        // and nothing has been written to it yet in this one
+        bool resumed;
+        // The contents of the ref's tree, if options.track_trees
+        tree_index tree;
     };
 
     ref* demand_ref(std::string const& name)
@@ -71,6 +86,13 @@ struct git_repository
         return &p->second;
     }
 
+    // The named ref, or null if nothing has been written to it
+    ref const* find_ref(std::string const& name) const
+    {
+        auto p = refs.find(name);
+        return p == refs.end() ? nullptr : &p->second;
+    }
+
     ref* modify_ref(std::string const& name, bool allow_discovery = true);
 
     // Begins a commit; returns the ref currently being written.
@@ -90,10 +112,43 @@ struct git_repository
 
     git_repository* in_super_module() const { return super_module; }
 
+    // True iff some other repository is a submodule of this one
+    bool is_super_module() const { return has_submodules; }
+
+    // The SHA of the blob already written to this repository for the
+    // SVN node-revision with the given id, or null if it was never
+    // written or has since been forgotten
+    std::string const* find_blob(std::string const& svn_node_id) const
+    {
+        return blobs.find(svn_node_id);
+    }
+
+    void remember_blob(std::string const& svn_node_id, std::string sha)
+    {
+        blobs.insert(svn_node_id, std::move(sha));
+    }
+
+    // With options.track_trees, these keep the current ref's tree
+    // index up to date with what's written to fast-import from
+    // outside this class.
+    void record_file(path const& git_path, unsigned long mode, std::string const& sha);
+    void record_tree_copy(
+        path const& git_path, std::string const& sha,
+        ref const* src_ref, std::size_t src_mark, path const& src_git_path);
+
+    // Incremental conversion support: write the state of this
+    // repository and its refs, or read back what a previous run wrote.
+    // find_repo maps a repository name to its git_repository.
+    void save_state(std::ostream& os) const;
+    void load_state(
+        std::istream& is, int last_mark,
+        std::function<git_repository*(std::string const&)> const& find_repo);
+
  private:
     void read_logfile();
     static bool ensure_existence(std::string const& git_dir);
     void write_merges();
+    std::string gitlink_sha(ref const* submodule_ref) const;
 
  private: // data members
     // Relative path to the repository from the current working
@@ -111,16 +166,32 @@ struct git_repository
     // If this is a submodule, of whom and were?
     git_repository* super_module;
     path submodule_path;
+    bool has_submodules;
 
     // branches and tags
     std::unordered_map<std::string, ref> refs;
     boost::container::flat_set<ref*> modified_refs; // to be written in current revision
 
+    // Maps SVN node-revision ids to the SHAs of blobs written for
+    // them; only the options.blob_cache_size most recently used are
+    // kept
+    mutable lru_cache<std::string, std::string> blobs;
+
     int last_mark;       // The last commit mark written to fast-import
     ref* current_ref;    // The ref to which the fast-import process is currently writing
     
     // Whether or not we've sent the "ls" command to git fast-import
     bool prepared_to_close_commit;
+
+    // With options.track_trees: the current ref's tree when its
+    // commit was opened, how that compares with its tree now, and
+    // whether we also asked fast-import for the former.
+    tree_index tree_at_open;
+    tree_index::comparison tree_comparison;
+    bool ls_previous_tree;
+
+    // Whether we asked fast-import for the SHA of the current commit
+    bool get_commit_sha;
 };
 
 #endif // GIT_REPOSITORY_DWA2013614_HPP
@@ -7,18 +7,37 @@
 #include "log.hpp"
 #include "path.hpp"
 #include "to_string.hpp"
+#include "sha1.hpp"
+#include <boost/filesystem.hpp>
 #include <boost/range/adaptor/map.hpp>
 #include <boost/function_output_iterator.hpp>
 #include <boost/range/as_literal.hpp>
 #include <svn_fs.h>
 #include <svn_version.h>
 #include <apr_hash.h>
+#include <algorithm>
+#include <fstream>
+#include <limits>
 
 using boost::adaptors::map_values;
 using boost::as_literal;
 
+// Enough for the bookkeeping of most revisions; bigger ones get more
+// memory from the heap until the end of the revision
+static std::size_t const revision_arena_size = 1024 * 1024;
+
 importer::importer(svn const& svn_repo, Ruleset const& ruleset)
-    : svn_repository(svn_repo), ruleset(ruleset), revnum(0)
+    : svn_repository(svn_repo), ruleset(ruleset), plaintext(svn_repo.repo_path),
+      snapshot_pending(options.snapshot),
+      arena_buffer(revision_arena_size),
+      revision_arena(arena_buffer.data(), arena_buffer.size()),
+      revnum(0),
+      svn_paths_to_convert(&revision_arena),
+      changed_repositories(&revision_arena),
+      deferred_conversions(&revision_arena),
+      svn_directory_copies(&revision_arena),
+      changed_paths(&revision_arena),
+      wholesale_copies(&revision_arena)
 {
     for(auto const& rule : ruleset.repositories())
     {
@@ -27,6 +46,15 @@ importer::importer(svn const& svn_repo, Ruleset const& ruleset)
         repo->set_super_module( 
             demand_repo(rule.submodule_in_repo), rule.submodule_path);
     }
+
+    if (!options.state_file.empty() && boost::filesystem::exists(options.state_file))
+        load_state(options.state_file);
+
+    if (options.prefetch_threads > 0 && !options.dry_run)
+    {
+        prefetcher.reset(
+            new file_prefetcher(svn_repository.repo_path, options.prefetch_threads));
+    }
 }
 
 // Return a pointer to a git_repository object having the given
@@ -54,6 +82,63 @@ int importer::last_valid_svn_revision()
     return revnum;
 }
 
+// The state file records the last SVN revision converted followed by
+// a block of per-ref state for each Git repository; see
+// git_repository::save_state.  It is written to a temporary file
+// first so that an interrupted run can't leave a truncated state
+// behind.
+void importer::save_state(std::string const& filename) const
+{
+    std::string const tmp_filename = filename + ".tmp";
+    {
+        std::ofstream os(tmp_filename.c_str());
+        if (os.fail())
+            throw std::runtime_error("Couldn't open state file for writing: " + tmp_filename);
+        os.exceptions( std::ofstream::failbit | std::ofstream::badbit );
+
+        os << "svn2git-state 1\n"
+           << "revision " << revnum << "\n";
+        for (auto const& repo : repositories | map_values)
+            repo.save_state(os);
+    }
+    boost::filesystem::rename(tmp_filename, filename);
+    Log::info() << "saved state at r" << revnum << " to " << filename << std::endl;
+}
+
+void importer::load_state(std::string const& filename)
+{
+    std::ifstream is(filename.c_str());
+    if (is.fail())
+        throw std::runtime_error("Couldn't open state file: " + filename);
+    is.exceptions( std::ifstream::badbit );
+
+    std::string magic, keyword;
+    int version = 0;
+    if (!(is >> magic >> version >> keyword >> revnum)
+        || magic != "svn2git-state" || version != 1 || keyword != "revision")
+    {
+        throw std::runtime_error("Unrecognized state file: " + filename);
+    }
+
+    auto find_repo = [&](std::string const& name) -> git_repository* {
+        auto p = repositories.find(name);
+        return p == repositories.end() ? nullptr : &p->second;
+    };
+
+    std::string name;
+    int last_mark;
+    while (is >> keyword >> name >> last_mark)
+    {
+        git_repository* repo = keyword == "repository" ? find_repo(name) : nullptr;
+        if (repo == nullptr)
+            throw std::runtime_error(
+                "In state file " + filename + ": unknown repository " + name);
+        is.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+        repo->load_state(is, last_mark, find_repo);
+    }
+    Log::info() << "resuming from r" << revnum << " using " << filename << std::endl;
+}
+
 // Unless the Git ref specified by match has already been completely
 // processed in this revision, find it, mark it for modification, and
 // return it.  Otherwise, discover_changes will be false.
@@ -136,11 +221,12 @@ void importer::process_svn_changes(svn::revision const& rev)
         // deleted, so it should never happen
         assert(change != nullptr); 
 
+        path const svn_path(svn_path_);
+        changed_paths.push_back(svn_path);
+
         // Ignore changes that only edit properties
         if (change->change_kind == svn_fs_path_change_modify && !change->text_mod)
             continue;
-
-        path const svn_path(svn_path_);
         
         // We have found a path being modified in SVN.  Note: it's
         // too early to error-out on unmapped SVN paths here: any that
@@ -161,6 +247,9 @@ void importer::process_svn_changes(svn::revision const& rev)
         if (change->node_kind != svn_node_file)
             process_svn_directory_change(rev, change, svn_path);
     }
+
+    // Sorted, the changes beneath any path form a contiguous range
+    std::sort(changed_paths.begin(), changed_paths.end());
 }
 
 void importer::process_svn_directory_change(
@@ -198,10 +287,13 @@ void importer::import_revision(int revnum)
     else if (revnum % 1000 == 0)
     {
         Log::info() << "importing revision " << revnum << std::endl;
+        stats::report_progress(Log::info()) << std::endl;
     }
+    stats::count_revision();
 
     this->revnum = revnum;
     svn::revision rev = svn_repository[revnum];
+    directory_matches.clear();
 
     // Importing an SVN revision happens in two phases.  In the first
     // phase we discover actions to be performed: Git subtrees that
@@ -212,16 +304,30 @@ void importer::import_revision(int revnum)
     //
     // Phase I: Action Discovery.  
     //
-    svn_paths_to_convert.clear();
-    changed_repositories.clear();
-    svn_directory_copies.clear();
 
     // Deal with rules becoming active/inactive in this revision
-    for (Rule const* r: ruleset.matcher().rules_in_transition(revnum))
-        invalidate_svn_tree(rev, r->svn_path(), r);
+    {
+        stats::timer t(stats::rule_transitions);
+        for (Rule const* r: ruleset.matcher().rules_in_transition(revnum))
+            invalidate_svn_tree(rev, r->svn_path(), r);
+
+        // A conversion that starts partway through the SVN history
+        // has to write everything that's there at the start
+        if (snapshot_pending)
+        {
+            ruleset.matcher().rules_in_effect(
+                revnum,
+                boost::make_function_output_iterator(
+                    [&](Rule const* r){ add_svn_tree_to_convert(rev, r->svn_path()); }));
+            snapshot_pending = false;
+        }
+    }
 
     // Discover SVN paths that are being deleted/modified
-    process_svn_changes(rev);
+    {
+        stats::timer t(stats::svn_changes);
+        process_svn_changes(rev);
+    }
 
     Log::trace() 
         << svn_paths_to_convert.size() 
@@ -229,26 +335,37 @@ void importer::import_revision(int revnum)
         << (svn_paths_to_convert.size() == 1 ? "path" : "paths")
         << " to convert" << std::endl;
 
-    discover_merges(rev);
+    {
+        stats::timer t(stats::merge_discovery);
+        discover_merges(rev);
+    }
 
     //
     // Phase II: Writing to Git
     //
+    if (prefetcher)
+    {
+        stats::timer t(stats::prefetching);
+        prefetch_files();
+    }
 
     // Though it is expected to be rare, a single SVN commit can
     // generate commits in multiple refs of the same Git repo.
     // However, the changes in a single Git ref's commit must all be
     // sent contiguously to the fast-import process.  Therefore, for
     // each Git ref that must be committed during this SVN revision, a
-    // separate pass over the SVN trees to convert is required.
+    // separate pass is required.
     //
-    // During each pass, we map SVN paths to Git, and may discover Git
-    // repositories and refs to that need to be committed in this SVN
-    // revision.  As we handle refs and repositories, we remove them
-    // from the set of changed things.  To avoid processing them
-    // again, this discovery is only enabled in the first pass.  This
-    // explains the "discover_changes" parameters you see in many of
-    // this class' member functions.
+    // The first pass walks the SVN trees to convert, mapping SVN paths
+    // to Git and discovering the Git repositories and refs that need
+    // to be committed in this SVN revision.  Paths belonging to a ref
+    // whose commit can't be opened yet are set aside in that ref's
+    // list of deferred_conversions, and later passes convert only the
+    // lists of the refs they open.  As we handle refs and
+    // repositories, we remove them from the set of changed things.
+    // To avoid processing them again, discovery is only enabled in
+    // the first pass.  This explains the "discover_changes"
+    // parameters you see in many of this class' member functions.
     int pass = 0;
     do
     {
@@ -261,14 +378,26 @@ void importer::import_revision(int revnum)
         }
 
         // Make a copy so it can be modified as we work this pass
-        auto changed_repos = changed_repositories;
-        for (auto r : changed_repos)
-            r->open_commit(rev);
+        boost::container::pmr::vector<git_repository*> changed_repos(
+            changed_repositories.begin(), changed_repositories.end(), &revision_arena);
+        {
+            stats::timer t(pass == 0 ? stats::first_pass : stats::later_passes);
+            for (auto r : changed_repos)
+                r->open_commit(rev);
         
-        auto paths_to_convert = svn_paths_to_convert;
-        for (auto& svn_path : paths_to_convert)
-            convert_svn_tree(rev, svn_path.c_str(), pass == 0);
+            if (pass == 0)
+            {
+                for (auto& svn_path : svn_paths_to_convert)
+                    convert_svn_tree(rev, svn_path, true);
+            }
+            else
+            {
+                for (auto r : changed_repos)
+                    convert_deferred(rev, r->open_commit(rev));
+            }
+        }
 
+        stats::timer t(stats::commit_closing);
         for (auto r : changed_repos)
             r->prepare_to_close_commit();
 
@@ -289,7 +418,19 @@ void importer::import_revision(int revnum)
     if (pass > 100)
         Log::warn() << "Processing r" << revnum << " took " << pass << "passes" << std::endl;
 
+    if (prefetcher)
+        prefetcher->cancel();
+
     warn_about_cross_repository_copies();
+
+    // Empty everything allocated from the arena before reclaiming it
+    svn_paths_to_convert.clear();
+    changed_repositories.clear();
+    svn_directory_copies.clear();
+    changed_paths.clear();
+    wholesale_copies.clear();
+    deferred_conversions.clear();
+    revision_arena.release();
 }
 
 void importer::warn_about_cross_repository_copies()
@@ -313,6 +454,21 @@ void importer::warn_about_cross_repository_copies()
     }
 }
 
+std::vector<stats::repository> importer::statistics()
+{
+    std::vector<stats::repository> result;
+    for (auto& repo : repositories | map_values)
+    {
+        git_fast_import const& fast_import = repo.fast_import();
+        stats::repository r = {
+            repo.name(), fast_import.bytes_written(),
+            fast_import.write_blocked_seconds(), fast_import.ls_wait_seconds()
+        };
+        result.push_back(r);
+    }
+    return result;
+}
+
 importer::~importer()
 {
     // Apparently there's at least some ordering constraint that is
@@ -324,16 +480,30 @@ importer::~importer()
         repo.fast_import().close();
 }
 
-template <class F>
+// A string identifying the SVN node-revision at svn_path.  Files with
+// the same node-revision id have the same contents and properties,
+// which lets us avoid sending the same contents to Git twice.
+static std::string svn_node_id(
+    svn::revision const& rev, path const& svn_path, apr_pool_t* pool)
+{
+    svn_fs_id_t const* id = svn::call(svn_fs_node_id, rev.fs_root, svn_path.c_str(), pool);
+    svn_string_t const* unparsed = svn_fs_unparse_id(id, pool);
+    return std::string(unparsed->data, unparsed->len);
+}
+
+// Call f for each file at or beneath svn_path, a node of the given
+// kind with node-revision id node_id.  Directories for which
+// handle_directory returns true are not entered.
+template <class F, class D>
 void for_each_svn_file(
-    svn::revision const& rev, path const& svn_path, F const& f, AprPool* pool_ = 0)
+    svn::revision const& rev, path const& svn_path, 
+    svn_node_kind_t kind, std::string const& node_id,
+    F const& f, D const& handle_directory)
 {
     if (boost::contains(svn_path.str(), "/CVSROOT/"))
         return;
 
-    auto& pool = pool_ ? *pool_ : rev.pool;
-
-    switch( svn::call(svn_fs_check_path, rev.fs_root, svn_path.c_str(), pool) )
+    switch( kind )
     {
     case svn_node_none: // If it turns out there's nothing here, there's nothing to do.
         Log::error() << svn_path << " doesn't exist!" << std::endl;
@@ -358,20 +528,34 @@ void for_each_svn_file(
         break;
 
     case svn_node_dir:
-        AprPool dir_pool = pool.make_subpool();
-        apr_hash_t *entries = svn::call(svn_fs_dir_entries, rev.fs_root, svn_path.c_str(), dir_pool);
-        for (apr_hash_index_t *i = apr_hash_first(dir_pool, entries); i; i = apr_hash_next(i))
-        {
-            char const* subpath;
-            void* value;
-            apr_hash_this(i, (void const **)&subpath, nullptr, nullptr);
-            for_each_svn_file(rev, svn_path/subpath, f, &dir_pool);
-        }
+        if (handle_directory(svn_path))
+            break;
+
+        // Hold on to the listing; visiting the entries may evict it
+        // from the cache
+        auto const entries = rev.entries(svn_path.c_str(), node_id);
+        for (auto const& entry : *entries)
+            for_each_svn_file(rev, svn_path/entry.name, entry.kind, entry.id, f, handle_directory);
         break;
 
     };
 }
 
+// Call f for each file at or beneath svn_path.  Directories for which
+// handle_directory returns true are not entered.
+template <class F, class D>
+void for_each_svn_file(
+    svn::revision const& rev, path const& svn_path, F const& f, D const& handle_directory)
+{
+    AprPool scope = rev.pool.make_subpool();
+    svn_node_kind_t const kind = svn::call(
+        svn_fs_check_path, rev.fs_root, svn_path.c_str(), scope);
+    for_each_svn_file(
+        rev, svn_path, kind, 
+        kind == svn_node_dir ? svn_node_id(rev, svn_path, scope) : std::string(),
+        f, handle_directory);
+}
+
 void importer::discover_merges(svn::revision const& rev)
 {
     for (auto& kv : svn_directory_copies)
@@ -385,10 +569,35 @@ void importer::discover_merges(svn::revision const& rev)
                     auto* dst_ref = prepare_to_modify(match, true);
                     record_merges(dst_ref, file_path, match);
                 }
+            },
+            [=](path const& dir_path)
+            {
+                // Every file in a wholesale copy merges from the same
+                // place, so there's no need to visit them all
+                wholesale_copy copy;
+                if (!find_wholesale_copy(dir_path, copy))
+                    return false;
+                wholesale_copies.push_back(dir_path);
+                auto* dst_ref = prepare_to_modify(copy.dst_match, true);
+                record_merges(dst_ref, dir_path, copy.dst_match);
+                return true;
             });
     }
 }
 
+// Have the prefetcher queue and read the files to be converted in
+// this revision on its own threads.  The first conversion pass won't
+// enter the wholesale copies, so neither should the prefetcher.
+void importer::prefetch_files()
+{
+    std::vector<path> skipped(wholesale_copies.begin(), wholesale_copies.end());
+    std::sort(skipped.begin(), skipped.end());
+    prefetcher->start(
+        revnum,
+        std::vector<path>(svn_paths_to_convert.begin(), svn_paths_to_convert.end()),
+        std::move(skipped));
+}
+
 void importer::convert_svn_tree(
     svn::revision const& rev, path const& svn_path, bool discover_changes)
 {
@@ -396,17 +605,123 @@ void importer::convert_svn_tree(
         rev, svn_path, 
         [=,&rev](path const& file_path) {
             convert_svn_file(rev, file_path, discover_changes); 
+        },
+        [=,&rev](path const& dir_path) {
+            return convert_svn_directory_copy(rev, dir_path, discover_changes);
         });
 }
 
+void importer::defer_conversion(git_repository::ref const* dst_ref, path const& svn_path)
+{
+    deferred_conversions[dst_ref].push_back(svn_path);
+}
+
+// Convert what was set aside until dst_ref's commit was open
+void importer::convert_deferred(svn::revision const& rev, git_repository::ref const* dst_ref)
+{
+    auto p = deferred_conversions.find(dst_ref);
+    if (p == deferred_conversions.end())
+        return;
+
+    // Converting these may defer work to other refs, and so
+    // invalidate p
+    auto svn_paths = std::move(p->second);
+    deferred_conversions.erase(p);
+
+    for (auto const& svn_path : svn_paths)
+        convert_svn_tree(rev, svn_path, false);
+}
+
+// If svn_path was copied wholesale from a tree that's already in Git,
+// write it as a reference to that tree rather than file-by-file.
+// Returns true iff that was done, or if nothing beneath svn_path can
+// be written in this pass anyway.
+bool importer::convert_svn_directory_copy(
+    svn::revision const& rev, path const& svn_path, bool discover_changes)
+{
+    wholesale_copy copy;
+    if (options.dry_run || !find_wholesale_copy(svn_path, copy))
+        return false;
+
+    auto& repo = repositories.find(copy.dst_match->git_repo_name())->second;
+
+    // Gitlinks are only written when the super-module's commit closes
+    if (repo.is_super_module())
+        return false;
+
+    // Find the commit that holds the source tree
+    auto const* src_ref = repo.find_ref(copy.src_match->git_ref_name());
+    if (src_ref == nullptr)
+        return false;
+    auto src_mark = src_ref->marks.upper_bound(copy.src_revnum);
+    if (src_mark == src_ref->marks.begin())
+        return false;
+    --src_mark;
+
+    path const src_git_path
+        = copy.src_match->git_path()/copy.src_path.sans_prefix(copy.src_match->svn_path());
+    path const dst_git_path
+        = copy.dst_match->git_path()/svn_path.sans_prefix(copy.dst_match->svn_path());
+
+    // A root tree also holds .gitattributes, which must not end up
+    // in a subdirectory
+    if (!options.gitattributes.empty() 
+        && src_git_path.str().empty() != dst_git_path.str().empty())
+    {
+        return false;
+    }
+
+    // The same reasons to come back in a later pass as in convert_svn_file
+    auto* dst_ref = prepare_to_modify(copy.dst_match, discover_changes);
+    if (dst_ref == nullptr)
+        return true;
+    changed_repositories.insert(&repo);
+    if (repo.open_commit(rev) != dst_ref)
+    {
+        defer_conversion(dst_ref, svn_path);
+        return true;
+    }
+
+    auto& fast_import = repo.fast_import();
+    fast_import.send_ls(
+        ":" + to_string(src_mark->second) + " " 
+        + (src_git_path.str().empty() ? "\"\"" : src_git_path.str()));
+
+    // Expect "040000 tree <sha> <path>".  The source may be missing,
+    // e.g. if it contains no files; convert whatever is there instead.
+    std::string const response = fast_import.readline();
+    if (!boost::starts_with(response, "040000 tree "))
+        return false;
+
+    Log::trace() << "copying Git tree of " << copy.src_path << "@" << copy.src_revnum
+                 << " to " << svn_path << std::endl;
+    std::string const tree_sha = response.substr(12, 40);
+    fast_import.filemodify(dst_git_path, 040000, tree_sha);
+    repo.record_tree_copy(dst_git_path, tree_sha, src_ref, src_mark->second, src_git_path);
+    return true;
+}
+
+// Where convert_svn_file streams file contents: the fast-import
+// process, and the hash that will name the resulting blob
+struct blob_sink
+{
+    blob_sink(git_fast_import& fast_import, std::size_t size)
+        : fast_import(fast_import), hasher("blob", size)
+    {}
+
+    git_fast_import& fast_import;
+    git_object_hasher hasher;
+};
+
 extern "C"
 {
     svn_error_t *fast_import_raw_bytes(void *baton, const char *data, apr_size_t *len)
     {
-        auto& fast_import = *static_cast<git_fast_import*>(baton);
+        auto& sink = *static_cast<blob_sink*>(baton);
         try
         {
-            fast_import.write_raw(data, *len);
+            sink.hasher.update(data, *len);
+            sink.fast_import.write_raw(data, *len);
             return SVN_NO_ERROR;
         }
         catch(std::exception const& e)
@@ -442,35 +757,97 @@ void importer::convert_svn_file(
     // 2. A different target ref is currently being written in this
     // repository.
     if (dst_ref->repo->open_commit(rev) != dst_ref)
+    {
+        defer_conversion(dst_ref, svn_path);
         return;
+    }
 
-    auto& fast_import = dst_ref->repo->fast_import();
+    auto& repo = *dst_ref->repo;
+    auto& fast_import = repo.fast_import();
+    path const git_path = match->git_path()/svn_path.sans_prefix(match->svn_path());
 
-    auto propvalue = svn::call(
-        svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:executable", rev.pool);
+    AprPool scope = rev.pool.make_subpool();
 
-    fast_import.filemodify_hdr(
-        match->git_path()/svn_path.sans_prefix(match->svn_path()), 
-        propvalue ? 0100755 : 0100644 );
+    // If this node-revision was already written to the repository,
+    // e.g. because its directory was copied or invalidated, refer to
+    // the existing blob instead of sending the contents again.
+    std::string const node_id = svn_node_id(rev, svn_path, scope);
+    if (auto sha = repo.find_blob(node_id))
+    {
+        auto propvalue = svn::call(
+            svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:executable", scope);
+        fast_import.filemodify(git_path, propvalue ? 0100755 : 0100644, *sha);
+        repo.record_file(git_path, propvalue ? 0100755 : 0100644, *sha);
+        return;
+    }
 
+    // The dump this revision was just loaded from may have carried
+    // the contents, sparing us their reconstruction from deltas
+    if (auto contents = rev.loaded_file(svn_path.c_str()))
+    {
+        auto propvalue = svn::call(
+            svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:executable", scope);
+        fast_import.filemodify_hdr(git_path, propvalue ? 0100755 : 0100644);
+        fast_import.data(contents->data(), contents->size());
+        std::string sha = git_blob_sha(contents->data(), contents->size());
+        repo.record_file(git_path, propvalue ? 0100755 : 0100644, sha);
+        repo.remember_blob(node_id, std::move(sha));
+        return;
+    }
+
+    // Contents stored verbatim in the repository can be sent without
+    // passing through libsvn or our own buffers.  The prefetcher
+    // leaves those alone.
     auto file_length = svn::call(
-        svn_fs_file_length, rev.fs_root, svn_path.c_str(), rev.pool);
+        svn_fs_file_length, rev.fs_root, svn_path.c_str(), scope);
+    auto const region = plaintext.find(node_id, file_length);
 
-    AprPool scope = rev.pool.make_subpool();
-    svn_stream_t* in_stream = svn::call(
-        svn_fs_file_contents, rev.fs_root, svn_path.c_str(), scope);
+    if (prefetcher && !region)
+    {
+        if (auto contents = prefetcher->take(svn_path))
+        {
+            fast_import.filemodify_hdr(git_path, contents->executable ? 0100755 : 0100644);
+            fast_import.data(contents->data.data(), contents->data.size());
+            repo.record_file(git_path, contents->executable ? 0100755 : 0100644, contents->sha);
+            repo.remember_blob(node_id, std::move(contents->sha));
+            return;
+        }
+    }
 
-    // If it's a symlink, we may need to lop 5 bytes off the front of the stream.
-    /*
-      svn_string_t *special = svn::call(
-      svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:special", scope);
-    */
+    auto propvalue = svn::call(
+        svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:executable", scope);
 
+    fast_import.filemodify_hdr(git_path, propvalue ? 0100755 : 0100644);
     fast_import.data_hdr(file_length);
-    svn_stream_t* out_stream = svn_stream_create(&fast_import, scope);
-    svn_stream_set_write(out_stream, fast_import_raw_bytes);
-    check_svn(svn_stream_copy3(in_stream, out_stream, nullptr, nullptr, scope));
+    std::string sha;
+
+    if (region)
+    {
+        mapped_region contents(*region);
+        fast_import.write_region(*region, contents.data());
+        sha = git_blob_sha(contents.data(), region->size);
+    }
+    else
+    {
+        svn_stream_t* in_stream = svn::call(
+            svn_fs_file_contents, rev.fs_root, svn_path.c_str(), scope);
+
+        // If it's a symlink, we may need to lop 5 bytes off the front of the stream.
+        /*
+          svn_string_t *special = svn::call(
+          svn_fs_node_prop, rev.fs_root, svn_path.c_str(), "svn:special", scope);
+        */
+
+        blob_sink sink(fast_import, file_length);
+        svn_stream_t* out_stream = svn_stream_create(&sink, scope);
+        svn_stream_set_write(out_stream, fast_import_raw_bytes);
+        check_svn(svn_stream_copy3(in_stream, out_stream, nullptr, nullptr, scope));
+        sha = sink.hasher.hex_digest();
+    }
     fast_import << LF;
+
+    repo.record_file(git_path, propvalue ? 0100755 : 0100644, sha);
+    repo.remember_blob(node_id, std::move(sha));
 }
 
 // Given the SVN path of a file being converted to Git, try to find an
@@ -479,10 +856,8 @@ void importer::convert_svn_file(
 void importer::record_merges(git_repository::ref* target, path const& dst_svn_path, Rule const* match)
 {
     // Look for an svn directory copy whose target contains svn_path
-    auto p = svn_directory_copies.lower_bound(dst_svn_path);
-    if (p == svn_directory_copies.begin())
-        return;
-    if (!dst_svn_path.starts_with((--p)->first))
+    auto p = find_directory_copy(dst_svn_path);
+    if (p == svn_directory_copies.end())
         return;
 
     // compute the path and revision in SVN corresponding to the
@@ -518,9 +893,106 @@ void importer::record_merges(git_repository::ref* target, path const& dst_svn_pa
     }
 }
 
+// The directory containing svn_path
+static path parent_directory(path const& svn_path)
+{
+    std::size_t const slash = svn_path.str().rfind('/');
+    return slash == std::string::npos ? path() : path(svn_path.str().substr(0, slash));
+}
+
+// Find the innermost directory copy in this revision whose
+// destination contains svn_path
+importer::directory_copy_map::iterator
+importer::find_directory_copy(path const& svn_path)
+{
+    if (svn_directory_copies.empty())
+        return svn_directory_copies.end();
+
+    for (path dir = svn_path;; dir = parent_directory(dir))
+    {
+        auto p = svn_directory_copies.find(dir);
+        if (p != svn_directory_copies.end() || dir.str().empty())
+            return p;
+    }
+}
+
+bool importer::find_wholesale_copy(path const& svn_path, wholesale_copy& result)
+{
+    auto p = find_directory_copy(svn_path);
+    if (p == svn_directory_copies.end())
+        return false;
+
+    // Anything changed at, above, or beneath svn_path within the copy
+    // means its contents aren't simply those of the source.  Property
+    // changes count, since svn:executable affects the Git tree.
+    auto changed = std::lower_bound(changed_paths.begin(), changed_paths.end(), svn_path);
+    if (changed != changed_paths.end() && *changed == p->first)
+        ++changed;
+    if (changed != changed_paths.end() && changed->starts_with(svn_path))
+        return false;
+
+    for (path dir = svn_path; dir != p->first;)
+    {
+        dir = parent_directory(dir);
+        if (dir != p->first 
+            && std::binary_search(changed_paths.begin(), changed_paths.end(), dir))
+            return false;
+    }
+
+    result.src_revnum = p->second.src_revision;
+    result.src_path = p->second.src_directory / svn_path.sans_prefix(p->first);
+    result.dst_match = match_svn_path(svn_path, revnum, false);
+    result.src_match = match_svn_path(result.src_path, result.src_revnum, false);
+
+    return result.dst_match && result.src_match
+        && result.dst_match->git_repo_name() == result.src_match->git_repo_name()
+        && maps_wholesale(result.dst_match, svn_path, revnum)
+        && maps_wholesale(result.src_match, result.src_path, result.src_revnum);
+}
+
+// True iff match is the only rule mapping anything within svn_path,
+// or anything into the Git tree where svn_path lands, at revnum
+bool importer::maps_wholesale(Rule const* match, path const& svn_path, std::size_t revnum)
+{
+    bool wholesale = true;
+    auto only_match = boost::make_function_output_iterator(
+        [&](Rule const* r){ if (r != match) wholesale = false; });
+
+    ruleset.matcher().svn_subtree_rules(svn_path.str(), revnum, only_match);
+
+    path const git_path = match->git_path()/svn_path.sans_prefix(match->svn_path());
+    ruleset.matcher().git_subtree_rules(
+        match->git_repo_name() + ":" + match->git_ref_name() + ":" + git_path.str(),
+        revnum, only_match);
+
+    return wholesale;
+}
+
+// Where the rule search for dir, in the revision being imported, has
+// got to.  Files in the same directory share its search.
+importer::rule_cursor const& importer::directory_match(std::string const& dir)
+{
+    auto found = directory_matches.find(dir);
+    if (found != directory_matches.end())
+        return found->second;
+
+    auto const& matcher = ruleset.matcher();
+    std::size_t const slash = dir.rfind('/');
+    rule_cursor c = slash == std::string::npos 
+        ? matcher.begin_search(revnum) : directory_match(dir.substr(0, slash));
+    matcher.advance(c, dir.begin() + (slash == std::string::npos ? 0 : slash), dir.end(), revnum);
+    return directory_matches.emplace(dir, c).first->second;
+}
+
 Rule const* importer::match_svn_path(path const& svn_path, std::size_t revnum, bool require_match)
 {
-    Rule const* match = ruleset.matcher().longest_match(svn_path.str(), revnum);
+    std::string const& p = svn_path.str();
+    std::size_t const slash = p.rfind('/');
+    Rule const* match = revnum == std::size_t(this->revnum) && slash != std::string::npos
+        ? ruleset.matcher().longest_match(
+            directory_match(p.substr(0, slash)), 
+            boost::make_iterator_range(p.begin() + slash, p.end()), revnum)
+        : ruleset.matcher().longest_match(p, revnum);
     if (require_match && match == nullptr)
     {
         Log::error() << "Unmatched svn path " << svn_path 
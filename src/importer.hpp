@@ -5,14 +5,23 @@
 # define IMPORTER_DWA2013614_HPP
 
 # include "git_repository.hpp"
+# include "file_prefetcher.hpp"
+# include "fsfs_plaintext.hpp"
 # include "path_set.hpp"
 # include "svn.hpp"
 # include "path.hpp"
 # include "ruleset.hpp"
+# include "stats.hpp"
 
 # include <boost/container/flat_set.hpp>
-# include <boost/container/flat_map.hpp>
+# include <boost/container/pmr/flat_map.hpp>
+# include <boost/container/pmr/flat_set.hpp>
+# include <boost/container/pmr/monotonic_buffer_resource.hpp>
+# include <boost/container/pmr/vector.hpp>
 # include <map>
+# include <memory>
+# include <unordered_map>
+# include <vector>
 
 struct Rule;
 struct Ruleset;
@@ -26,6 +35,14 @@ struct importer
     int last_valid_svn_revision();
     void import_revision(int revnum);
 
+    // Incremental conversion support: save everything needed to
+    // continue the conversion in a later run, or load it back.
+    void save_state(std::string const& filename) const;
+    void load_state(std::string const& filename);
+
+    // What has been sent to each Git repository so far
+    std::vector<stats::repository> statistics();
+
  private: // helpers
     git_repository* demand_repo(std::string const& name);
     git_repository::ref* prepare_to_modify(Rule const* match, bool discover_changes);
@@ -41,21 +58,57 @@ struct importer
         svn::revision const& rev, path const& svn_path, bool discover_changes);
     void convert_svn_file(
         svn::revision const& rev, path const& svn_path, bool discover_changes);
+    bool convert_svn_directory_copy(
+        svn::revision const& rev, path const& svn_path, bool discover_changes);
+    void defer_conversion(git_repository::ref const* dst_ref, path const& svn_path);
+    void convert_deferred(svn::revision const& rev, git_repository::ref const* dst_ref);
     void discover_merges(svn::revision const& rev);
+    void prefetch_files();
     void record_merges(git_repository::ref*, path const& svn_path, Rule const* match);
 
     void warn_about_cross_repository_copies();
     Rule const* match_svn_path(path const& svn_path, std::size_t revnum, bool require_match = true);
 
+    typedef patrie<Rule, coverage>::cursor rule_cursor;
+    rule_cursor const& directory_match(std::string const& dir);
+
+    struct wholesale_copy;
+    bool find_wholesale_copy(path const& svn_path, wholesale_copy& result);
+    bool maps_wholesale(Rule const* match, path const& svn_path, std::size_t revnum);
+
  private: // persistent members
     std::map<std::string, git_repository> repositories;
     svn const& svn_repository;
     Ruleset const& ruleset;
+    std::unique_ptr<file_prefetcher> prefetcher;
+
+    // Finds file contents that can be sent to Git straight from the
+    // SVN repository's files
+    fsfs_plaintext plaintext;
+
+    // Whether the first revision imported must convert the whole
+    // SVN tree, as it stands, rather than just what changed
+    bool snapshot_pending;
 
  private: // members used per SVN revision
+    // Containers below that are rebuilt for each revision allocate
+    // from here.  It is reclaimed all at once when the revision is done.
+    // The paths they hold still keep their text on the heap.
+    std::vector<char> arena_buffer;
+    boost::container::pmr::monotonic_buffer_resource revision_arena;
+
     int revnum;
     path_set svn_paths_to_convert;
-    boost::container::flat_set<git_repository*> changed_repositories;
+    boost::container::pmr::flat_set<git_repository*> changed_repositories;
+
+    // SVN paths whose conversion had to wait for a commit to be
+    // opened in the ref they belong to, in the order they were found
+    boost::container::pmr::flat_map<
+        git_repository::ref const*, boost::container::pmr::vector<path>
+    > deferred_conversions;
+
+    // Rule searches for directory paths, at revnum
+    std::unordered_map<std::string, rule_cursor> directory_matches;
 
     struct svn_directory_copy
     {
@@ -72,7 +125,26 @@ struct importer
     };
 
     // A map from destination directory to (source revision, directory) pairs
-    boost::container::flat_map<path, svn_directory_copy> svn_directory_copies;
+    typedef boost::container::pmr::flat_map<path, svn_directory_copy> directory_copy_map;
+    directory_copy_map svn_directory_copies;
+    directory_copy_map::iterator find_directory_copy(path const& svn_path);
+
+    // Every path changed in this revision, sorted
+    boost::container::pmr::vector<path> changed_paths;
+
+    // Directories found, while discovering merges, to be wholesale copies
+    boost::container::pmr::vector<path> wholesale_copies;
+
+    // A directory whose files all arrived, unchanged, through a
+    // directory copy, and where a single rule maps everything in
+    // both the source and the destination into one Git repository.
+    struct wholesale_copy
+    {
+        Rule const* src_match;
+        Rule const* dst_match;
+        path src_path;
+        std::size_t src_revnum;
+    };
 };
 
 #endif // IMPORTER_DWA2013614_HPP
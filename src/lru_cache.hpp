@@ -0,0 +1,77 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef LRU_CACHE_DWA2013801_HPP
+# define LRU_CACHE_DWA2013801_HPP
+
+# include <cassert>
+# include <cstddef>
+# include <functional>
+# include <list>
+# include <unordered_map>
+# include <utility>
+
+// A map holding at most a fixed number of entries.  Making room for a
+// new entry discards the one least recently found or inserted.
+template <class Key, class Value, class Hash = std::hash<Key> >
+class lru_cache
+{
+    typedef std::list<std::pair<Key, Value> > entry_list;
+
+ public:
+    explicit lru_cache(std::size_t capacity) : capacity(capacity)
+    {
+        assert(capacity > 0);
+    }
+
+    // The value stored for key, or null if there is none
+    Value* find(Key const& key)
+    {
+        auto const p = index.find(key);
+        if (p == index.end())
+            return nullptr;
+        touch(p->second);
+        return &p->second->second;
+    }
+
+    // Store value for key, replacing any value already stored
+    Value& insert(Key const& key, Value value)
+    {
+        auto const p = index.find(key);
+        if (p != index.end())
+        {
+            p->second->second = std::move(value);
+            touch(p->second);
+            return p->second->second;
+        }
+
+        if (entries.size() == capacity)
+        {
+            index.erase(entries.back().first);
+            entries.pop_back();
+        }
+        entries.emplace_front(key, std::move(value));
+        index.emplace(key, entries.begin());
+        return entries.front().second;
+    }
+
+    std::size_t size() const { return entries.size(); }
+
+    void clear()
+    {
+        index.clear();
+        entries.clear();
+    }
+
+ private:
+    void touch(typename entry_list::iterator pos)
+    {
+        entries.splice(entries.begin(), entries, pos);
+    }
+
+    std::size_t capacity;
+    entry_list entries; // Most recently used first
+    std::unordered_map<Key, typename entry_list::iterator, Hash> index;
+};
+
+#endif // LRU_CACHE_DWA2013801_HPP
@@ -17,6 +17,9 @@
 
 #include <boost/program_options.hpp>
 #include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/file_descriptor.hpp>
+#include <boost/iostreams/stream.hpp>
 
 #include <fstream>
 #include <limits.h>
@@ -34,12 +37,40 @@
 
 Options options;
 
+// Whether git fast-import answers "get-mark", which it learned in git
+// 2.6
+static bool fast_import_has_get_mark()
+{
+    namespace process = boost::process;
+    namespace iostreams = boost::iostreams;
+    using namespace process::initializers;
+
+    process::pipe const output = process::create_pipe();
+    {
+        std::vector<std::string> const args = { git_executable(), "--version" };
+        iostreams::file_descriptor_sink sink(output.sink, iostreams::close_handle);
+        process::child git = process::execute(
+            run_exe(git_executable()), set_args(args), bind_stdout(sink), throw_on_error());
+        process::wait_for_exit(git);
+    }
+
+    // "git version 2.39.2"
+    iostreams::stream<iostreams::file_descriptor_source> version(
+        output.source, iostreams::close_handle);
+    std::string git, version_word;
+    int major = 0, minor = 0;
+    char dot;
+    version >> git >> version_word >> major >> dot >> minor;
+    return major > 2 || (major == 2 && minor >= 6);
+}
+
 int main(int argc, char **argv)
 {
     bool exit_success = false;
     std::string authors_file;
     std::string gitattributes_path;
     std::string svn_path;
+    std::string svn_dump;
     int resume_from = 0;
     int max_rev = 0;
     bool dump_rules = false;
@@ -59,6 +90,7 @@ int main(int argc, char **argv)
             ("exit-success", "exit with 0, even if errors occured")
             ("authors", po::value(&authors_file)->value_name("FILENAME"), "map between svn username and email")
             ("svnrepo", po::value(&svn_path)->value_name("PATH")->required(), "path to svn repository")
+            ("svndump", po::value(&svn_dump)->value_name("FILENAME"), "load the output of \"svnadmin dump\" from FILENAME (- for stdin) into the svn repository, which is created if need be, converting each revision as it arrives")
             ("rules", po::value(&options.rules_file)->value_name("FILENAME")->required(), "file with the conversion rules")
             ("gitattributes,a", po::value(&gitattributes_path)->value_name("PATH"), "A file whose contents to inject as .gitattributes in every Git repository")
             ("dry-run", "Write no Git repositories")
@@ -67,7 +99,15 @@ int main(int argc, char **argv)
             ("add-metadata-notes", "if passed, each git commit will have notes with svn commit info")
             ("resume-from", po::value(&resume_from)->value_name("REVISION"), "start importing at svn revision number")
             ("max-rev", po::value(&max_rev)->value_name("REVISION"), "stop importing at svn revision number")
+            ("snapshot", "with --resume-from, begin with a commit of everything in SVN at that point rather than just its changes")
+            ("state-file", po::value(&options.state_file)->value_name("FILENAME"), "persist the importer state to FILENAME at exit, and resume from it if it exists")
+            ("stats", po::value(&options.stats_file)->value_name("FILENAME"), "write time spent in each phase and bytes sent to each repository to FILENAME as JSON at exit")
             ("debug-rules", "print what rule is being used for each file")
+            ("track-trees", "keep track of Git tree contents to tell when a commit changes nothing, instead of asking git fast-import")
+            ("native-packs", "write Git packs directly instead of running git fast-import")
+            ("gitlink-marks", "write each submodule gitlink as the submodule commit's mark, zero-padded to 40 digits, for fix-submodule-refs to rewrite, instead of the commit's SHA (always so with git before 2.6)")
+            ("prefetch-threads", po::value(&options.prefetch_threads)->value_name("NUMBER")->default_value(0), "read SVN file contents on NUMBER threads ahead of writing them to Git")
+            ("blob-cache-size", po::value(&options.blob_cache_size)->value_name("NUMBER")->default_value(16384), "remember the blobs written for up to NUMBER SVN file node-revisions in each Git repository, to refer to them rather than send their contents again; each takes a couple hundred bytes")
             ("commit-interval", po::value(&options.commit_interval)->value_name("NUMBER")->default_value(10000), "if passed the cache will be flushed to git every NUMBER of commits")
             ("svn-branches", "Use the contents of SVN when creating branches, Note: SVN tags are branches as well")
             ("dump-rules", "Dump the contents of the rule trie and exit")
@@ -112,8 +152,27 @@ int main(int argc, char **argv)
         options.coverage = variables.count("coverage");
         options.debug_rules = variables.count("debug-rules");
         options.svn_branches = variables.count("svn-branches");
+        options.track_trees = variables.count("track-trees");
+        options.native_packs = variables.count("native-packs");
+        options.gitlink_marks = variables.count("gitlink-marks");
+        options.snapshot = variables.count("snapshot");
         notify(variables);
 
+        // Native packs don't start from what a previous run imported
+        if (options.native_packs && !options.state_file.empty())
+            throw std::runtime_error("--native-packs can't be combined with --state-file");
+        if (options.snapshot && !options.state_file.empty())
+            throw std::runtime_error("--snapshot can't be combined with --state-file");
+
+        // Without get-mark, gitlinks can't hold SHAs from the start
+        if (!options.gitlink_marks && !options.dry_run && !options.native_packs
+            && !fast_import_has_get_mark())
+        {
+            Log::warn() << git_executable() << " predates fast-import's get-mark; "
+                "writing gitlinks as marks for fix-submodule-refs to rewrite" << std::endl;
+            options.gitlink_marks = true;
+        }
+
 
         // Load the configuration
         Log::info() << "reading ruleset..." << std::endl;
@@ -134,6 +193,12 @@ int main(int argc, char **argv)
             exit(r ? 0 : 1);
         }
 
+        if (!svn_dump.empty() && !boost::filesystem::exists(svn_path))
+        {
+            Log::info() << "Creating SVN repository at " << svn_path << std::endl;
+            svn::create(svn_path);
+        }
+
         Log::info() << "Opening SVN repository at " << svn_path << std::endl;
         svn svn_repo(svn_path, authors_file);
 
@@ -154,12 +219,36 @@ int main(int argc, char **argv)
         Log::info() << "done preparing repositories and import processes." << std::endl;
 
         if (max_rev < 1)
-            max_rev = svn_repo.latest_revision();
+            max_rev = svn_dump.empty() ? svn_repo.latest_revision() : INT_MAX;
 
         Log::info() << "Using git executable: " << git_executable() << std::endl;
 
-        for (int i = std::max(resume_from, imp.last_valid_svn_revision()); ++i <= max_rev;)
-            imp.import_revision(i);
+        // Convert everything up through the given revision that hasn't
+        // been converted yet.  Returns false once max_rev is reached.
+        int revnum = std::max(resume_from, imp.last_valid_svn_revision());
+        auto import_through = [&](int latest)
+        {
+            while (revnum < std::min(latest, max_rev))
+                imp.import_revision(++revnum);
+            return revnum < max_rev;
+        };
+
+        if (import_through(svn_repo.latest_revision()) && !svn_dump.empty())
+        {
+            Log::info() << "Loading SVN dump from " << svn_dump << std::endl;
+            svn_repo.load_dump(svn_dump, import_through);
+        }
+
+        if (!options.state_file.empty())
+            imp.save_state(options.state_file);
+
+        if (!options.stats_file.empty())
+        {
+            std::ofstream stats_file(options.stats_file);
+            stats::report(stats_file, imp.statistics());
+            if (!stats_file)
+                throw std::runtime_error("Couldn't write statistics to " + options.stats_file);
+        }
 
         coverage::report();
     }
@@ -4,30 +4,109 @@
 #ifndef MARK_SHA_MAP_DWA2013515_HPP
 # define MARK_SHA_MAP_DWA2013515_HPP
 
+# include "file_region.hpp"
+# include "sha1.hpp"
+# include "to_string.hpp"
 # include <algorithm>
-# include <vector>
+# include <cstdint>
+# include <stdexcept>
 # include <string>
+# include <vector>
+# include <sys/stat.h>
+
+// Maps the marks of objects written by git fast-import to their SHAs.
+// Marks are handed out consecutively, so the SHAs are kept in a table
+// indexed by mark, where all zeros means the mark is unmapped.
+class mark_sha_map
+{
+ public:
+    typedef sha1::digest_type sha_type;
+
+    // Read a marks file as written by git fast-import --export-marks,
+    // one ":<mark> <sha>" line per object.  Throws if the file is
+    // malformed or maps a mark twice.
+    void load(std::string const& filename);
+
+    // The SHA of the object with the given mark, or null
+    sha_type const* find(std::size_t mark) const
+    {
+        if (mark >= shas.size() || shas[mark] == sha_type())
+            return nullptr;
+        return &shas[mark];
+    }
+
+ private:
+    // The value of a lowercase hex digit, or -1.  Looked up in a
+    // table, as branching on random digits mispredicts too often.
+    static int hex_value(char c)
+    {
+        static struct table
+        {
+            table()
+            {
+                std::fill(values, values + 256, -1);
+                for (int i = 0; i < 10; ++i)
+                    values['0' + i] = i;
+                for (int i = 0; i < 6; ++i)
+                    values['a' + i] = 10 + i;
+            }
+            signed char values[256];
+        } const digits;
+        return digits.values[static_cast<unsigned char>(c)];
+    }
+
+ private:
+    std::vector<sha_type> shas;
+};
+
+inline void mark_sha_map::load(std::string const& filename)
+{
+    shared_fd const fd = open_shared_fd(filename);
+    struct stat st;
+    if (!fd || ::fstat(*fd, &st) != 0)
+        throw std::runtime_error("Couldn't open marks file: " + filename);
 
-typedef std::vector<std::pair<unsigned long, std::string> > mark_sha_map;
+    file_region const whole = { fd, 0, static_cast<std::uint64_t>(st.st_size) };
+    mapped_region const contents(whole);
+    char const* p = contents.data();
+    char const* const end = p + whole.size;
 
-struct compare_marks
-  {
-  bool operator()(mark_sha_map::const_reference lhs, unsigned long rhs) const
+    // Marks beyond this are surely bogus, and would make a huge table
+    std::size_t const max_mark = 1UL << 30;
+
+    for (std::size_t line = 1; p != end; ++line)
     {
-    return lhs.first < rhs;
+        auto malformed = [&](char const* what) {
+            return std::runtime_error(filename + ":" + to_string(line) + ": " + what);
+        };
+
+        if (*p++ != ':')
+            throw malformed("expected ':'");
+        std::size_t mark = 0;
+        char const* const digits = p;
+        while (p != end && *p >= '0' && *p <= '9' && mark <= max_mark)
+            mark = mark * 10 + (*p++ - '0');
+        if (p == digits || mark > max_mark || p == end || *p++ != ' ')
+            throw malformed("expected a mark number");
+
+        if (end - p < 41 || p[40] != '\n')
+            throw malformed("expected a SHA");
+        sha_type sha;
+        for (int i = 0; i < 20; ++i, p += 2)
+        {
+            int const high = hex_value(p[0]), low = hex_value(p[1]);
+            if (high < 0 || low < 0)
+                throw malformed("expected a SHA");
+            sha[i] = static_cast<unsigned char>(high << 4 | low);
+        }
+        ++p;
+
+        if (mark >= shas.size())
+            shas.resize(std::max(mark + 1, shas.size() * 2));
+        if (shas[mark] != sha_type())
+            throw malformed("duplicate mark");
+        shas[mark] = sha;
     }
-  };
-
-inline mark_sha_map::iterator
-find_sha_pos(mark_sha_map& m, unsigned long mark)
-  {
-  return std::lower_bound(m.begin(), m.end(), mark, compare_marks());
-  }
-
-inline mark_sha_map::const_iterator
-find_sha_pos(mark_sha_map const& m, unsigned long mark)
-  {
-  return std::lower_bound(m.begin(), m.end(), mark, compare_marks());
-  }
+}
 
 #endif // MARK_SHA_MAP_DWA2013515_HPP
@@ -0,0 +1,543 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "native_fast_import.hpp"
+#include "marks_file_name.hpp"
+#include "sha1.hpp"
+#include "log.hpp"
+#include "stats.hpp"
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+
+using boost::starts_with;
+
+namespace
+{
+  // Only the quoting git_fast_import actually produces: `""`, and
+  // the simplest C-style escapes
+  std::string unquote(std::string const& s)
+  {
+      if (s.size() < 2 || s[0] != '"')
+          return s;
+      std::string result;
+      for (std::size_t i = 1; i + 1 < s.size(); ++i)
+      {
+          char c = s[i];
+          if (c == '\\' && i + 2 < s.size())
+          {
+              c = s[++i];
+              if (c == 'n') c = '\n';
+              else if (c == 't') c = '\t';
+          }
+          result.push_back(c);
+      }
+      return result;
+  }
+
+  std::string octal(unsigned long mode, bool pad)
+  {
+      char buf[16];
+      std::snprintf(buf, sizeof(buf), pad ? "%06lo" : "%lo", mode);
+      return buf;
+  }
+
+  std::size_t max_cached_trees = 100000;
+}
+
+native_fast_import::native_fast_import(std::string const& git_dir)
+    : git_dir(git_dir),
+      pack(git_dir),
+      data_remaining(0),
+      reading_data(false),
+      inline_mode(0),
+      context(top_level),
+      commit_mark(0),
+      base_chosen(false),
+      closed(false),
+      bytes_consumed(0),
+      busy_seconds(0)
+{}
+
+native_fast_import::~native_fast_import()
+{
+    try
+    {
+        close();
+    }
+    catch(std::exception const& e)
+    {
+        Log::error() << "Failed to finish writing " << git_dir << ": " << e.what() << std::endl;
+    }
+}
+
+void native_fast_import::write(char const* s, std::size_t n)
+{
+    double const start = stats::wall_clock();
+    bytes_consumed += n;
+    write_commands(s, n);
+    busy_seconds += stats::wall_clock() - start;
+}
+
+void native_fast_import::write_commands(char const* s, std::size_t n)
+{
+    while (n > 0)
+    {
+        if (reading_data)
+        {
+            std::size_t const take = std::min(n, data_remaining);
+            data.append(s, take);
+            s += take;
+            n -= take;
+            data_remaining -= take;
+            if (data_remaining == 0)
+            {
+                reading_data = false;
+                std::string d;
+                swap(d, data);
+                handle_data(std::move(d));
+            }
+            continue;
+        }
+
+        char const* nl = static_cast<char const*>(std::memchr(s, '\n', n));
+        if (nl == nullptr)
+        {
+            line.append(s, n);
+            return;
+        }
+        line.append(s, nl);
+        n -= nl + 1 - s;
+        s = nl + 1;
+
+        std::string l;
+        swap(l, line);
+        handle_line(l);
+    }
+}
+
+std::string native_fast_import::readline()
+{
+    if (responses.empty())
+        throw std::runtime_error("In " + git_dir + ": no response to read");
+    std::string result = std::move(responses.front());
+    responses.pop_front();
+    return result;
+}
+
+void native_fast_import::handle_line(std::string const& line)
+{
+    if (line.empty() || line[0] == '#')
+        return;
+
+    if (starts_with(line, "commit "))
+    {
+        end_commit();
+        begin_commit(line.substr(7));
+    }
+    else if (starts_with(line, "reset "))
+    {
+        end_commit();
+        context = in_reset;
+        ref_name = line.substr(6);
+        branches[ref_name] = branch();
+    }
+    else if (line == "checkpoint")
+    {
+        end_commit();
+    }
+    else if (starts_with(line, "ls "))
+    {
+        ls(line.substr(3));
+    }
+    else if (starts_with(line, "get-mark "))
+    {
+        end_commit();
+        responses.push_back(find_mark(line.substr(9)).commit_sha);
+    }
+    else if (starts_with(line, "from ") && context == in_reset)
+    {
+        mark const& m = find_mark(line.substr(5));
+        branch& b = branches[ref_name];
+        b.commit_sha = m.commit_sha;
+        b.root = entry(040000, m.tree_sha);
+    }
+    else if (context != in_commit)
+    {
+        throw std::runtime_error("In " + git_dir + ": unsupported fast-import command: " + line);
+    }
+    else if (starts_with(line, "mark :"))
+    {
+        commit_mark = std::strtoul(line.c_str() + 6, nullptr, 10);
+    }
+    else if (starts_with(line, "committer "))
+    {
+        committer = line.substr(10);
+    }
+    else if (starts_with(line, "data "))
+    {
+        data_remaining = std::strtoul(line.c_str() + 5, nullptr, 10);
+        reading_data = data_remaining > 0;
+        if (!reading_data)
+            handle_data(std::string());
+    }
+    else if (starts_with(line, "from "))
+    {
+        mark const& m = find_mark(line.substr(5));
+        parents.assign(1, m.commit_sha);
+        root = entry(040000, m.tree_sha);
+        base_chosen = true;
+    }
+    else if (starts_with(line, "merge "))
+    {
+        choose_base();
+        parents.push_back(find_mark(line.substr(6)).commit_sha);
+    }
+    else if (starts_with(line, "M "))
+    {
+        // M <mode> <dataref> <path>
+        choose_base();
+        std::size_t const space1 = line.find(' ', 2);
+        std::size_t const space2 = line.find(' ', space1 + 1);
+        if (space2 == std::string::npos)
+            throw std::runtime_error("In " + git_dir + ": malformed command: " + line);
+        unsigned long const mode = std::strtoul(line.c_str() + 2, nullptr, 8);
+        std::string const dataref = line.substr(space1 + 1, space2 - space1 - 1);
+        std::string const path = unquote(line.substr(space2 + 1));
+        if (dataref == "inline")
+        {
+            inline_path = path;
+            inline_mode = mode;
+        }
+        else
+        {
+            entry const e(mode, dataref);
+            assign(root, path, 0, &e);
+        }
+    }
+    else if (starts_with(line, "D "))
+    {
+        choose_base();
+        assign(root, unquote(line.substr(2)), 0, nullptr);
+    }
+    else
+    {
+        throw std::runtime_error("In " + git_dir + ": unsupported fast-import command: " + line);
+    }
+}
+
+void native_fast_import::handle_data(std::string data)
+{
+    if (inline_mode != 0)
+    {
+        entry const e(inline_mode, pack.write(pack_writer::blob, std::move(data)));
+        assign(root, inline_path, 0, &e);
+        inline_mode = 0;
+    }
+    else
+    {
+        message = std::move(data);
+    }
+}
+
+void native_fast_import::begin_commit(std::string const& ref)
+{
+    context = in_commit;
+    ref_name = ref;
+    commit_mark = 0;
+    committer.clear();
+    message.clear();
+    parents.clear();
+    base_chosen = false;
+    root = entry();
+}
+
+// Without an explicit "from", a commit continues its branch
+void native_fast_import::choose_base()
+{
+    if (base_chosen)
+        return;
+    base_chosen = true;
+
+    auto b = branches.find(ref_name);
+    if (b != branches.end() && !b->second.commit_sha.empty())
+    {
+        parents.insert(parents.begin(), b->second.commit_sha);
+        root = b->second.root;
+    }
+}
+
+void native_fast_import::end_commit()
+{
+    if (context != in_commit)
+    {
+        context = top_level;
+        return;
+    }
+    choose_base();
+
+    std::string const tree_sha = store(root);
+    std::string commit = "tree " + tree_sha + "\n";
+    for (auto const& p : parents)
+        commit += "parent " + p + "\n";
+    commit += "author " + committer + "\n";
+    commit += "committer " + committer + "\n\n";
+    commit += message;
+
+    std::string const commit_sha = pack.write(pack_writer::commit, std::move(commit));
+    if (commit_mark != 0)
+    {
+        mark& m = marks[commit_mark];
+        m.commit_sha = commit_sha;
+        m.tree_sha = tree_sha;
+    }
+
+    branch& b = branches[ref_name];
+    b.commit_sha = commit_sha;
+    b.root = std::move(root);
+    root = entry();
+    context = top_level;
+}
+
+native_fast_import::mark const& native_fast_import::find_mark(std::string const& dataref) const
+{
+    auto m = dataref.size() > 1 && dataref[0] == ':'
+        ? marks.find(std::strtoul(dataref.c_str() + 1, nullptr, 10)) : marks.end();
+    if (m == marks.end())
+        throw std::runtime_error("In " + git_dir + ": unknown mark " + dataref);
+    return m->second;
+}
+
+// ls [<dataref> ]<path>
+void native_fast_import::ls(std::string const& args)
+{
+    entry from_mark;
+    entry* base = &root;
+    std::string path = args;
+
+    if (!args.empty() && args[0] == ':')
+    {
+        std::size_t const space = args.find(' ');
+        from_mark = entry(040000, find_mark(args.substr(0, space)).tree_sha);
+        base = &from_mark;
+        path = space == std::string::npos ? std::string() : args.substr(space + 1);
+    }
+    else if (context == in_commit)
+    {
+        choose_base();
+    }
+    else
+    {
+        throw std::runtime_error("In " + git_dir + ": ls without a commit: " + args);
+    }
+    path = unquote(path);
+
+    entry* e = lookup(*base, path);
+    if (e == nullptr)
+    {
+        responses.push_back("missing " + path);
+        return;
+    }
+
+    std::string const sha = store(*e);
+    char const* const type = e->is_tree() ? "tree" : e->mode == 0160000 ? "commit" : "blob";
+    responses.push_back(octal(e->mode, true) + " " + type + " " + sha + "\t" + path);
+}
+
+native_fast_import::tree& native_fast_import::load(entry& e)
+{
+    if (e.contents)
+        return *e.contents;
+
+    if (e.sha.empty())
+    {
+        e.contents = std::make_shared<tree>();
+        return *e.contents;
+    }
+
+    auto cached = tree_cache.find(e.sha);
+    if (cached != tree_cache.end())
+    {
+        e.contents = cached->second;
+        return *e.contents;
+    }
+
+    pack_writer::object_type type;
+    std::string raw;
+    if (!pack.read(e.sha, type, raw) || type != pack_writer::tree)
+        throw std::runtime_error("In " + git_dir + ": tree " + e.sha + " is not in the pack");
+
+    // Each entry is "<octal mode> <name>\0<20-byte SHA>"
+    auto t = std::make_shared<tree>();
+    for (std::size_t pos = 0; pos < raw.size();)
+    {
+        std::size_t const space = raw.find(' ', pos);
+        std::size_t const nul = raw.find('\0', space);
+        if (space == std::string::npos || nul == std::string::npos || nul + 21 > raw.size())
+            throw std::runtime_error("In " + git_dir + ": corrupt tree " + e.sha);
+
+        sha1::digest_type d;
+        std::copy(raw.begin() + nul + 1, raw.begin() + nul + 21, d.begin());
+        t->entries.emplace(
+            raw.substr(space + 1, nul - space - 1),
+            entry(std::strtoul(raw.c_str() + pos, nullptr, 8), sha1::to_hex(d)));
+        pos = nul + 21;
+    }
+
+    if (tree_cache.size() >= max_cached_trees)
+        tree_cache.clear();
+    tree_cache.emplace(e.sha, t);
+    e.contents = std::move(t);
+    return *e.contents;
+}
+
+// Prepare to change the directory e, which may be shared
+native_fast_import::tree& native_fast_import::modify(entry& e)
+{
+    load(e);
+    if (e.contents.use_count() > 1)
+        e.contents = std::make_shared<tree>(*e.contents);
+    e.sha.clear();
+    return *e.contents;
+}
+
+// Replace whatever is at path[pos...] within e by *new_entry, or
+// remove it if new_entry is null
+void native_fast_import::assign(
+    entry& e, std::string const& path, std::size_t pos, entry const* new_entry)
+{
+    if (pos >= path.size())
+    {
+        e = new_entry ? *new_entry : entry();
+        return;
+    }
+
+    // Writing beneath a file replaces it with a directory
+    if (!e.is_tree())
+    {
+        if (new_entry == nullptr)
+            return;
+        e = entry();
+    }
+
+    std::size_t slash = path.find('/', pos);
+    if (slash == std::string::npos)
+        slash = path.size();
+    std::string const name = path.substr(pos, slash - pos);
+
+    tree& t = modify(e);
+    auto p = t.entries.find(name);
+    if (p == t.entries.end())
+    {
+        if (new_entry == nullptr)
+            return;
+        p = t.entries.emplace(name, entry()).first;
+    }
+    assign(p->second, path, slash + 1, new_entry);
+
+    // Git has no empty directories
+    entry const& child = p->second;
+    if (child.is_tree() && child.sha.empty() && (!child.contents || child.contents->entries.empty()))
+        t.entries.erase(p);
+}
+
+native_fast_import::entry* native_fast_import::lookup(entry& e, std::string const& path)
+{
+    entry* result = &e;
+    for (std::size_t pos = 0; pos < path.size();)
+    {
+        if (!result->is_tree())
+            return nullptr;
+
+        std::size_t slash = path.find('/', pos);
+        if (slash == std::string::npos)
+            slash = path.size();
+
+        tree& t = load(*result);
+        auto p = t.entries.find(path.substr(pos, slash - pos));
+        if (p == t.entries.end())
+            return nullptr;
+        result = &p->second;
+        pos = slash + 1;
+    }
+    return result;
+}
+
+// Write the directory e, and any of its subdirectories that changed,
+// to the pack.  Returns e's SHA.
+std::string const& native_fast_import::store(entry& e)
+{
+    if (!e.is_tree() || !e.sha.empty())
+        return e.sha;
+
+    tree& t = load(e);
+
+    // Git sorts tree entries as though directory names ended in '/'
+    std::vector<std::pair<std::string, entry*> > sorted;
+    sorted.reserve(t.entries.size());
+    for (auto& kv : t.entries)
+    {
+        store(kv.second);
+        sorted.emplace_back(kv.first + (kv.second.is_tree() ? "/" : ""), &kv.second);
+    }
+    std::sort(sorted.begin(), sorted.end(),
+              [](std::pair<std::string, entry*> const& x, std::pair<std::string, entry*> const& y)
+              { return x.first < y.first; });
+
+    std::string raw;
+    for (auto const& s : sorted)
+    {
+        raw += octal(s.second->mode, false);
+        raw += ' ';
+        raw.append(s.first, 0, s.first.size() - (s.second->is_tree() ? 1 : 0));
+        raw += '\0';
+        auto const d = sha1::from_hex(s.second->sha);
+        raw.append(reinterpret_cast<char const*>(d.data()), d.size());
+    }
+
+    e.sha = pack.write(pack_writer::tree, std::move(raw));
+    if (tree_cache.size() >= max_cached_trees)
+        tree_cache.clear();
+    tree_cache.emplace(e.sha, e.contents);
+    return e.sha;
+}
+
+void native_fast_import::close()
+{
+    if (closed)
+        return;
+    closed = true;
+
+    end_commit();
+    pack.finish();
+
+    // Loose refs take precedence over any packed ones
+    for (auto const& kv : branches)
+    {
+        boost::filesystem::path const ref_path = boost::filesystem::path(git_dir) / kv.first;
+        if (kv.second.commit_sha.empty())
+        {
+            boost::filesystem::remove(ref_path);
+            continue;
+        }
+        boost::filesystem::create_directories(ref_path.parent_path());
+        std::ofstream ref_file(ref_path.string().c_str());
+        ref_file << kv.second.commit_sha << "\n";
+        if (!ref_file)
+            throw std::runtime_error("Couldn't write ref " + ref_path.string());
+    }
+
+    // The same format as fast-import's --export-marks
+    std::ofstream marks_file(marks_file_path(git_dir).c_str());
+    for (auto const& kv : marks)
+        marks_file << ":" << kv.first << " " << kv.second.commit_sha << "\n";
+    if (!marks_file)
+        throw std::runtime_error("Couldn't write " + marks_file_path(git_dir));
+}
@@ -0,0 +1,125 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef NATIVE_FAST_IMPORT_DWA2013726_HPP
+# define NATIVE_FAST_IMPORT_DWA2013726_HPP
+
+# include "pack_writer.hpp"
+# include <cstdint>
+# include <deque>
+# include <map>
+# include <memory>
+# include <string>
+# include <unordered_map>
+# include <vector>
+
+// An in-process stand-in for git fast-import, for the subset of its
+// protocol that git_fast_import produces: commit, reset, ls, get-mark
+// and checkpoint commands, and within commits, mark, committer, data,
+// from, merge, M and D.  Objects go into a single new pack per
+// repository; the refs and the marks file are written on close().
+class native_fast_import
+{
+ public:
+    explicit native_fast_import(std::string const& git_dir);
+    ~native_fast_import();
+
+    // Consume n bytes of the command stream
+    void write(char const* s, std::size_t n);
+
+    // The next response to an "ls" or "get-mark" command
+    std::string readline();
+
+    // Complete any open commit and write everything out
+    void close();
+
+    std::uint64_t bytes_written() const { return bytes_consumed; }
+
+    // Time spent interpreting the command stream
+    double seconds_busy() const { return busy_seconds; }
+
+ private:
+    struct tree;
+    struct entry
+    {
+        entry() : mode(040000) {}
+        entry(unsigned long mode, std::string sha) : mode(mode), sha(std::move(sha)) {}
+
+        bool is_tree() const { return mode == 040000; }
+
+        unsigned long mode;
+        std::string sha;                 // Empty for a directory not yet stored
+        std::shared_ptr<tree> contents;  // Directories only; null until loaded
+    };
+
+    struct tree
+    {
+        std::map<std::string, entry> entries;
+    };
+
+    struct branch
+    {
+        std::string commit_sha;
+        entry root;
+    };
+
+    struct mark
+    {
+        std::string commit_sha;
+        std::string tree_sha;
+    };
+
+    void write_commands(char const* s, std::size_t n);
+    void handle_line(std::string const& line);
+    void handle_data(std::string data);
+    void begin_commit(std::string const& ref_name);
+    void choose_base();
+    void end_commit();
+    void ls(std::string const& args);
+    mark const& find_mark(std::string const& dataref) const;
+
+    tree& load(entry& e);
+    tree& modify(entry& e);
+    void assign(entry& e, std::string const& path, std::size_t pos, entry const* new_entry);
+    entry* lookup(entry& e, std::string const& path);
+    std::string const& store(entry& e);
+
+ private:
+    std::string git_dir;
+    pack_writer pack;
+
+    // Command stream parsing state
+    std::string line;
+    std::size_t data_remaining;
+    bool reading_data;
+    std::string data;
+
+    // What "data" is for: the commit message, or a file
+    std::string inline_path;
+    unsigned long inline_mode;
+
+    enum { top_level, in_commit, in_reset } context;
+    std::string ref_name;  // of the open commit or reset
+
+    // The open commit
+    std::size_t commit_mark;
+    std::string committer;
+    std::string message;
+    std::vector<std::string> parents;
+    bool base_chosen;
+    entry root;
+
+    std::map<std::string, branch> branches;
+    std::map<std::size_t, mark> marks;
+    std::deque<std::string> responses;
+
+    // Recently used trees, so they needn't be read back from the pack
+    std::unordered_map<std::string, std::shared_ptr<tree> > tree_cache;
+
+    bool closed;
+
+    std::uint64_t bytes_consumed;
+    double busy_seconds;
+};
+
+#endif // NATIVE_FAST_IMPORT_DWA2013726_HPP
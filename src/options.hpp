@@ -28,10 +28,18 @@ struct Options
   bool debug_rules;
   bool coverage;
   int commit_interval;
+  int prefetch_threads;
+  int blob_cache_size;
+  bool track_trees;
+  bool native_packs;
+  bool gitlink_marks;
+  bool snapshot;
   bool svn_branches;
   std::string rules_file;
   std::string git_executable;
   std::string gitattributes;
+  std::string state_file;
+  std::string stats_file;
   };
 
 extern Options options;
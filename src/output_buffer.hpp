@@ -0,0 +1,90 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef OUTPUT_BUFFER_DWA2013802_HPP
+# define OUTPUT_BUFFER_DWA2013802_HPP
+
+# include <boost/utility/string_ref.hpp>
+# include <cstdint>
+# include <cstring>
+# include <functional>
+# include <vector>
+
+// Collects a command stream in one contiguous block, formatting text
+// and numbers straight into it, and hands the block to a sink when it
+// fills up or is flushed.  Writes at least as large as the block go
+// to the sink directly, after whatever is buffered, without being
+// copied.
+class output_buffer
+{
+ public:
+    typedef std::function<void(char const*, std::size_t)> sink_type;
+
+    output_buffer(std::size_t capacity, sink_type sink)
+        : buffer(capacity), used(0), sink(std::move(sink))
+    {}
+
+    void put(char c)
+    {
+        if (used == buffer.size())
+            flush();
+        buffer[used++] = c;
+    }
+
+    void put(boost::string_ref s)
+    {
+        write(s.data(), s.size());
+    }
+
+    // Write n in the given base, which is at most 10
+    void put_unsigned(std::uintmax_t n, unsigned base = 10)
+    {
+        char digits[sizeof(n) * 3];   // Enough for base 8
+        char* start = digits + sizeof(digits);
+        do
+        {
+            *--start = '0' + n % base;
+            n /= base;
+        }
+        while (n != 0);
+        write(start, digits + sizeof(digits) - start);
+    }
+
+    void write(char const* data, std::size_t n)
+    {
+        if (n <= buffer.size() - used)
+        {
+            std::memcpy(buffer.data() + used, data, n);
+            used += n;
+            return;
+        }
+
+        flush();
+        if (n < buffer.size())
+        {
+            std::memcpy(buffer.data(), data, n);
+            used = n;
+        }
+        else
+        {
+            sink(data, n);
+        }
+    }
+
+    void flush()
+    {
+        if (used == 0)
+            return;
+        // Empty the buffer first; the sink may throw
+        std::size_t const n = used;
+        used = 0;
+        sink(buffer.data(), n);
+    }
+
+ private:
+    std::vector<char> buffer;
+    std::size_t used;
+    sink_type sink;
+};
+
+#endif // OUTPUT_BUFFER_DWA2013802_HPP
@@ -0,0 +1,472 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "pack_writer.hpp"
+#include "log.hpp"
+#include "sha1.hpp"
+
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+#include <zlib.h>
+
+namespace
+{
+  // The threads on which all pack_writers deflate their objects
+  class deflate_pool
+  {
+   public:
+      deflate_pool()
+          : stopping(false)
+      {
+          unsigned n = std::max(1u, std::thread::hardware_concurrency());
+          for (unsigned i = 0; i < n; ++i)
+              threads.emplace_back([this]{ run(); });
+      }
+
+      ~deflate_pool()
+      {
+          {
+              std::lock_guard<std::mutex> lock(mutex);
+              stopping = true;
+          }
+          work_available.notify_all();
+          for (auto& t : threads)
+              t.join();
+      }
+
+      void submit(std::function<void()> task)
+      {
+          {
+              std::lock_guard<std::mutex> lock(mutex);
+              tasks.push_back(std::move(task));
+          }
+          work_available.notify_one();
+      }
+
+   private:
+      void run()
+      {
+          std::unique_lock<std::mutex> lock(mutex);
+          while (true)
+          {
+              work_available.wait(lock, [this]{ return stopping || !tasks.empty(); });
+              if (tasks.empty())
+                  return;
+              auto task = std::move(tasks.front());
+              tasks.pop_front();
+              lock.unlock();
+              task();
+              lock.lock();
+          }
+      }
+
+      std::mutex mutex;
+      std::condition_variable work_available;
+      std::deque<std::function<void()> > tasks;
+      bool stopping;
+      std::vector<std::thread> threads;
+  };
+
+  deflate_pool& pool()
+  {
+      static deflate_pool p;
+      return p;
+  }
+
+  char const* type_name(pack_writer::object_type type)
+  {
+      return type == pack_writer::commit ? "commit"
+          : type == pack_writer::tree ? "tree" : "blob";
+  }
+
+  std::string binary_sha(std::string const& hex)
+  {
+      auto const d = sha1::from_hex(hex);
+      return std::string(d.begin(), d.end());
+  }
+
+  void put32(std::string& s, std::uint32_t x)
+  {
+      for (int shift = 24; shift >= 0; shift -= 8)
+          s.push_back(static_cast<char>(x >> shift));
+  }
+
+  void write_all(int fd, char const* p, std::size_t n)
+  {
+      while (n > 0)
+      {
+          ssize_t written = ::write(fd, p, n);
+          if (written < 0)
+          {
+              if (errno == EINTR)
+                  continue;
+              throw std::runtime_error(std::string("writing pack: ") + std::strerror(errno));
+          }
+          p += written;
+          n -= written;
+      }
+  }
+
+  std::size_t read_at(int fd, char* p, std::size_t n, std::uint64_t offset)
+  {
+      std::size_t total = 0;
+      while (total < n)
+      {
+          ssize_t r = ::pread(fd, p + total, n - total, offset + total);
+          if (r < 0)
+          {
+              if (errno == EINTR)
+                  continue;
+              throw std::runtime_error(std::string("reading pack: ") + std::strerror(errno));
+          }
+          if (r == 0)
+              break;
+          total += r;
+      }
+      return total;
+  }
+}
+
+struct pack_writer::job
+{
+    std::string sha;  // binary
+    object_type type;
+    std::string data;
+    std::string packed;  // entry header and deflated data
+    bool done;
+};
+
+pack_writer::pack_writer(std::string const& git_dir)
+    : git_dir(git_dir),
+      tmp_path(git_dir + "/objects/pack/tmp_pack_svn2git"),
+      fd(-1),
+      finished(false),
+      queued_bytes(0),
+      tasks_outstanding(0),
+      writing(false),
+      offset(0)
+{
+    boost::filesystem::create_directories(git_dir + "/objects/pack");
+    fd = ::open(tmp_path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0444);
+    if (fd < 0)
+        throw std::runtime_error("Couldn't create " + tmp_path + ": " + std::strerror(errno));
+
+    // The object count is filled in by finish()
+    std::string header("PACK");
+    put32(header, 2);
+    put32(header, 0);
+    write_all(fd, header.data(), header.size());
+    offset = header.size();
+}
+
+pack_writer::~pack_writer()
+{
+    try
+    {
+        finish();
+    }
+    catch(std::exception const& e)
+    {
+        Log::error() << "Failed to finish pack in " << git_dir << ": " << e.what() << std::endl;
+    }
+}
+
+void pack_writer::check_error()
+{
+    if (!error.empty())
+        throw std::runtime_error("writing pack in " + git_dir + ": " + error);
+}
+
+std::string pack_writer::write(object_type type, std::string data)
+{
+    git_object_hasher hasher(type_name(type), data.size());
+    hasher.update(data);
+    auto const digest = hasher.digest();
+    std::string sha(digest.begin(), digest.end());
+
+    // Don't let more than this much pile up waiting for the deflaters
+    std::size_t const capacity = 64 * 1024 * 1024;
+
+    std::shared_ptr<job> j;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (written.count(sha) || in_flight.count(sha))
+            return sha1::to_hex(digest);
+
+        progress.wait(lock, [&]{ return queued_bytes < capacity || !error.empty(); });
+        check_error();
+
+        j = std::make_shared<job>();
+        j->sha = sha;
+        j->type = type;
+        j->data = std::move(data);
+        j->done = false;
+        queue.push_back(j);
+        in_flight[sha] = j;
+        queued_bytes += j->data.size();
+        ++tasks_outstanding;
+    }
+
+    pool().submit([this, j]{ 
+            deflate(*j); 
+            write_ready(); 
+            std::lock_guard<std::mutex> lock(mutex);
+            --tasks_outstanding;
+            progress.notify_all();
+        });
+    return sha1::to_hex(digest);
+}
+
+void pack_writer::deflate(job& j)
+{
+    std::string packed;
+    try
+    {
+        // Entry header: type and size, 4 bits of size in the first
+        // byte and 7 in each one following
+        std::uint64_t size = j.data.size();
+        unsigned char c = static_cast<unsigned char>((j.type << 4) | (size & 0xF));
+        size >>= 4;
+        while (size)
+        {
+            packed.push_back(static_cast<char>(c | 0x80));
+            c = size & 0x7F;
+            size >>= 7;
+        }
+        packed.push_back(static_cast<char>(c));
+
+        std::size_t const header_size = packed.size();
+        uLongf deflated_size = compressBound(j.data.size());
+        packed.resize(header_size + deflated_size);
+        int status = compress2(
+            reinterpret_cast<Bytef*>(&packed[header_size]), &deflated_size,
+            reinterpret_cast<Bytef const*>(j.data.data()), j.data.size(),
+            Z_DEFAULT_COMPRESSION);
+        if (status != Z_OK)
+            throw std::runtime_error("deflate failed");
+        packed.resize(header_size + deflated_size);
+    }
+    catch(std::exception const& e)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (error.empty())
+            error = e.what();
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    j.packed = std::move(packed);
+    j.done = true;
+}
+
+// Append whatever has been deflated at the front of the queue to the
+// pack.  Only one thread does this at a time; any others leave their
+// objects for it.
+void pack_writer::write_ready()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    if (writing)
+        return;
+    writing = true;
+
+    while (!queue.empty() && queue.front()->done)
+    {
+        std::shared_ptr<job> j = std::move(queue.front());
+        queue.pop_front();
+        std::uint64_t const at = offset;
+        bool const failed = !error.empty();
+        lock.unlock();
+
+        std::uint32_t crc = 0;
+        std::string write_error;
+        if (!failed)
+        {
+            try
+            {
+                write_all(fd, j->packed.data(), j->packed.size());
+                crc = crc32(
+                    0, reinterpret_cast<Bytef const*>(j->packed.data()), j->packed.size());
+            }
+            catch(std::exception const& e)
+            {
+                write_error = e.what();
+            }
+        }
+
+        lock.lock();
+        if (!write_error.empty() && error.empty())
+            error = write_error;
+        location const l = { at, crc };
+        written.emplace(j->sha, l);
+        offset += j->packed.size();
+        in_flight.erase(j->sha);
+        queued_bytes -= j->data.size();
+    }
+
+    writing = false;
+    progress.notify_all();
+}
+
+bool pack_writer::read(std::string const& sha, object_type& type, std::string& data)
+{
+    if (sha.size() != 40)
+        return false;
+    std::string const key = binary_sha(sha);
+    std::uint64_t at;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto j = in_flight.find(key);
+        if (j != in_flight.end())
+        {
+            type = j->second->type;
+            data = j->second->data;
+            return true;
+        }
+        auto w = written.find(key);
+        if (w == written.end())
+            return false;
+        at = w->second.offset;
+    }
+
+    // Decode the entry header
+    unsigned char header[16];
+    std::size_t n = read_at(fd, reinterpret_cast<char*>(header), sizeof(header), at);
+    std::size_t i = 0;
+    unsigned char c = header[i++];
+    type = static_cast<object_type>((c >> 4) & 7);
+    std::uint64_t size = c & 0xF;
+    for (int shift = 4; c & 0x80 && i < n; shift += 7)
+    {
+        c = header[i++];
+        size |= std::uint64_t(c & 0x7F) << shift;
+    }
+
+    // Inflate the data
+    data.resize(size);
+    z_stream z;
+    std::memset(&z, 0, sizeof(z));
+    if (inflateInit(&z) != Z_OK)
+        throw std::runtime_error("inflateInit failed");
+    z.next_out = reinterpret_cast<Bytef*>(&data[0]);
+    z.avail_out = size;
+
+    std::vector<char> buffer(64 * 1024);
+    std::uint64_t pos = at + i;
+    int status = Z_OK;
+    while (status == Z_OK)
+    {
+        std::size_t got = read_at(fd, buffer.data(), buffer.size(), pos);
+        if (got == 0)
+            break;
+        pos += got;
+        z.next_in = reinterpret_cast<Bytef*>(buffer.data());
+        z.avail_in = got;
+        status = inflate(&z, Z_NO_FLUSH);
+    }
+    inflateEnd(&z);
+    if (status != Z_STREAM_END)
+        throw std::runtime_error("corrupt object " + sha + " in pack");
+    return true;
+}
+
+void pack_writer::finish()
+{
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (finished)
+            return;
+        progress.wait(lock, [this]{ return tasks_outstanding == 0; });
+        finished = true;
+    }
+    check_error();
+
+    if (written.empty())
+    {
+        ::close(fd);
+        boost::filesystem::remove(tmp_path);
+        return;
+    }
+
+    // Fill in the object count, then checksum the whole pack
+    std::string count;
+    put32(count, written.size());
+    if (::pwrite(fd, count.data(), count.size(), 8) != 4)
+        throw std::runtime_error("updating pack header: " + std::string(std::strerror(errno)));
+
+    sha1 pack_hasher;
+    std::vector<char> buffer(1024 * 1024);
+    for (std::uint64_t pos = 0; pos < offset;)
+    {
+        std::size_t got = read_at(
+            fd, buffer.data(), std::min<std::uint64_t>(buffer.size(), offset - pos), pos);
+        if (got == 0)
+            throw std::runtime_error("pack is shorter than expected");
+        pack_hasher.update(buffer.data(), got);
+        pos += got;
+    }
+    auto const pack_sha = pack_hasher.digest();
+    ::lseek(fd, offset, SEEK_SET);
+    write_all(fd, reinterpret_cast<char const*>(pack_sha.data()), pack_sha.size());
+    ::close(fd);
+
+    // Build the version 2 index
+    std::vector<std::pair<std::string, location> > entries(written.begin(), written.end());
+    std::sort(entries.begin(), entries.end(),
+              [](std::pair<std::string, location> const& x, std::pair<std::string, location> const& y)
+              { return x.first < y.first; });
+
+    std::string idx("\377tOc");
+    put32(idx, 2);
+    std::uint32_t fanout[256] = {};
+    for (auto const& e : entries)
+        ++fanout[static_cast<unsigned char>(e.first[0])];
+    for (int i = 1; i < 256; ++i)
+        fanout[i] += fanout[i - 1];
+    for (auto n : fanout)
+        put32(idx, n);
+    for (auto const& e : entries)
+        idx += e.first;
+    for (auto const& e : entries)
+        put32(idx, e.second.crc);
+
+    std::string large_offsets;
+    for (auto const& e : entries)
+    {
+        if (e.second.offset < 0x80000000u)
+        {
+            put32(idx, e.second.offset);
+        }
+        else
+        {
+            put32(idx, 0x80000000u | (large_offsets.size() / 8));
+            put32(large_offsets, e.second.offset >> 32);
+            put32(large_offsets, e.second.offset & 0xFFFFFFFFu);
+        }
+    }
+    idx += large_offsets;
+    idx.append(reinterpret_cast<char const*>(pack_sha.data()), pack_sha.size());
+    auto const idx_sha = sha1().update(idx).digest();
+    idx.append(reinterpret_cast<char const*>(idx_sha.data()), idx_sha.size());
+
+    std::string const name = git_dir + "/objects/pack/pack-" + sha1::to_hex(pack_sha);
+    std::string const tmp_idx_path = tmp_path + ".idx";
+    int idx_fd = ::open(tmp_idx_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0444);
+    if (idx_fd < 0)
+        throw std::runtime_error("Couldn't create " + tmp_idx_path + ": " + std::strerror(errno));
+    write_all(idx_fd, idx.data(), idx.size());
+    ::close(idx_fd);
+
+    // Git only looks for packs that have an index
+    boost::filesystem::rename(tmp_path, name + ".pack");
+    boost::filesystem::rename(tmp_idx_path, name + ".idx");
+
+    Log::info() << "wrote " << entries.size() << " objects to " << name << ".pack" << std::endl;
+}
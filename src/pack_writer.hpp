@@ -0,0 +1,70 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PACK_WRITER_DWA2013726_HPP
+# define PACK_WRITER_DWA2013726_HPP
+
+# include <condition_variable>
+# include <cstdint>
+# include <deque>
+# include <memory>
+# include <mutex>
+# include <string>
+# include <unordered_map>
+
+// Writes a Git packfile of whole (undeltified) objects, and its
+// version 2 index, into a repository.  Objects are deflated on a pool
+// of threads shared by all pack_writers, and appended to the pack in
+// the order they were written.
+class pack_writer
+{
+ public:
+    enum object_type { commit = 1, tree = 2, blob = 3 };
+
+    explicit pack_writer(std::string const& git_dir);
+    ~pack_writer();
+
+    // Add an object, unless the pack already has it.  Returns its SHA
+    std::string write(object_type type, std::string data);
+
+    // Read back an object that was written earlier.  Returns false if
+    // there's no such object.
+    bool read(std::string const& sha, object_type& type, std::string& data);
+
+    // Complete the pack and its index, and move them into place
+    void finish();
+
+ private:
+    struct job;
+    void deflate(job& j);
+    void write_ready();
+    void check_error();
+
+ private:
+    std::string git_dir;
+    std::string tmp_path;
+    int fd;
+    bool finished;
+
+    std::mutex mutex;
+    std::condition_variable progress;
+
+    // Objects waiting to be deflated or appended, in order
+    std::deque<std::shared_ptr<job> > queue;
+    std::unordered_map<std::string, std::shared_ptr<job> > in_flight;
+    std::size_t queued_bytes;
+    std::size_t tasks_outstanding;  // submitted to the deflate pool
+    bool writing;  // whether some thread is appending to the pack
+    std::string error;
+
+    // Objects already in the pack, by binary SHA
+    struct location
+    {
+        std::uint64_t offset;
+        std::uint32_t crc;
+    };
+    std::unordered_map<std::string, location> written;
+    std::uint64_t offset;
+};
+
+#endif // PACK_WRITER_DWA2013726_HPP
@@ -9,9 +9,12 @@
 # include <boost/operators.hpp>
 # include <boost/range/iterator_range.hpp>
 # include <boost/iterator/iterator_facade.hpp>
+# include <boost/utility/string_ref.hpp>
 # include <utility>
 # include <ostream>
 # include <algorithm>
+# include <climits>
+# include <cstring>
 
 // A wrapper for Git/SVN path strings.  Boost.Filesystem's path is
 // inappropriate for this purpose because of
@@ -79,6 +82,10 @@ struct path : boost::totally_ordered<path>
         : text(path::trim(std::move(x)))
     {}
 
+    path(boost::string_ref x)
+        : path(path::trim(x).to_string())
+    {}
+
     path(path const&) = default;
     path(path&&) = default;
     path& operator=(path const&) = default;
@@ -93,10 +100,13 @@ struct path : boost::totally_ordered<path>
         );
     }
 
-    std::string sans_prefix(path const& prefix) const
+    // The rest of this path after prefix.  Refers to this path's
+    // storage, so that it can be appended to another path without
+    // first being copied.
+    boost::string_ref sans_prefix(path const& prefix) const
     {
         assert(starts_with(prefix));
-        return text.substr(prefix.text.size());
+        return trim(boost::string_ref(text).substr(prefix.text.size()));
     }
 
     friend bool operator==(path const& p0, path const& p1)
@@ -104,11 +114,17 @@ struct path : boost::totally_ordered<path>
         return p0.text == p1.text;
     }
 
+    // Orders paths component by component, so that a directory's
+    // contents sort right after it.  Because a separator ends a
+    // component, treating it as lower than every other character
+    // gives the same result as comparing the components themselves.
     friend bool operator<(path const& p0, path const& p1)
     {
-        return std::lexicographical_compare(
-            component_iterator(p0), component_iterator(p0.str().end()),
-            component_iterator(p1), component_iterator(p1.str().end()));
+        std::size_t const n = std::min(p0.text.size(), p1.text.size());
+        auto const diff = std::mismatch(p0.text.begin(), p0.text.begin() + n, p1.text.begin());
+        if (diff.first == p0.text.begin() + n)
+            return p0.text.size() < p1.text.size();
+        return rank(*diff.first) < rank(*diff.second);
     }
 
     friend void swap(path& p0, path& p1)
@@ -132,20 +148,61 @@ struct path : boost::totally_ordered<path>
         return text;
     }
 
-    friend path operator/(path lhs, path const& rhs)
+    friend path operator/(path const& lhs, path const& rhs)
+    {
+        return join(lhs, rhs.text);
+    }
+
+    friend path operator/(path const& lhs, boost::string_ref rhs)
+    {
+        return join(lhs, trim(rhs));
+    }
+
+    friend path operator/(path const& lhs, std::string const& rhs)
+    {
+        return lhs / boost::string_ref(rhs);
+    }
+
+    friend path operator/(path const& lhs, char const* rhs)
     {
-        if (!lhs.str().empty() && !rhs.str().empty())
-            lhs.text.push_back('/');
-        lhs.text += rhs.text;
-        return lhs;
+        return lhs / boost::string_ref(rhs);
     }
+
  private:
+    path(std::string x, bool /* already trimmed */) : text(std::move(x)) {}
+
+    // Appends rhs, which must already be trimmed, allocating only once
+    static path join(path const& lhs, boost::string_ref rhs)
+    {
+        std::string result;
+        result.reserve(lhs.text.size() + 1 + rhs.size());
+        result = lhs.text;
+        if (!lhs.text.empty() && !rhs.empty())
+            result.push_back('/');
+        result.append(rhs.data(), rhs.size());
+        return path(std::move(result), true);
+    }
+
+    static int rank(char c)
+    {
+        return c == '/' ? INT_MIN : c;
+    }
+
     static std::string trim(std::string x) 
     { 
         boost::algorithm::trim_if(x, boost::is_any_of("/"));
         return x;
     }
 
+    static boost::string_ref trim(boost::string_ref x)
+    {
+        while (!x.empty() && x.front() == '/')
+            x.remove_prefix(1);
+        while (!x.empty() && x.back() == '/')
+            x.remove_suffix(1);
+        return x;
+    }
+
  private:
     std::string text;
 };
@@ -5,33 +5,160 @@
 # define PATH_SET_DWA2013615_HPP
 
 #include "path.hpp"
-#include <boost/algorithm/string/predicate.hpp>
+#include <boost/container/pmr/map.hpp>
+#include <boost/container/pmr/string.hpp>
+#include <boost/utility/string_ref.hpp>
+#include <boost/iterator/iterator_facade.hpp>
 #include <algorithm>
+#include <initializer_list>
+#include <string>
+#include <utility>
 #include <vector>
 
+// A set of paths in which no path is beneath another: inserting a
+// path removes everything beneath it, and inserting a path beneath
+// one that's already there does nothing.  Paths are kept in a tree of
+// their components, so each insertion costs time proportional to its
+// depth, plus whatever it removes.  Iteration yields paths in order.
+//
+// The tree, including its components' names, can be allocated from a
+// memory resource such as an arena that is released all at once;
+// copies use the default resource.  The members themselves are
+// paths, which always live on the heap.
 class path_set
 {
-    typedef std::vector<path> storage;
+    // Components are ordered just as path's operator< orders them.
+    // They can be looked up without being copied into the resource.
+    struct component_less
+    {
+        typedef void is_transparent;
+
+        template <class S1, class S2>
+        bool operator()(S1 const& lhs, S2 const& rhs) const
+        {
+            return std::lexicographical_compare(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+        }
+    };
+
+    struct node;
+    typedef boost::container::pmr::string component;
+    typedef boost::container::pmr::map<component, node, component_less> children_map;
+
+    struct node
+    {
+        explicit node(boost::container::pmr::memory_resource* resource)
+            : count(0), is_member(false), children(children_map::allocator_type(resource))
+        {}
+
+        std::size_t count;   // Members at or beneath this node
+        bool is_member;      // If so, there's nothing beneath it
+        path value;          // Valid if is_member
+        children_map children;
+    };
+
  public:
+    typedef path value_type;
 
-    path_set() {}
+    class const_iterator
+      : public boost::iterator_facade<
+            const_iterator, path const, std::forward_iterator_tag>
+    {
+     public:
+        const_iterator() : current(nullptr) {}
 
-    path_set(std::initializer_list<path> const& x)
-        : paths(x)
+     private:
+        friend class path_set;
+        friend class boost::iterator_core_access;
+
+        // Move to the first member at or beneath the node at the top
+        // of the stack
+        void descend()
+        {
+            node const* n = &stack.back().first->second;
+            while (!n->is_member)
+            {
+                stack.emplace_back(n->children.begin(), n->children.end());
+                n = &stack.back().first->second;
+            }
+            current = n;
+        }
+
+        void increment()
+        {
+            while (!stack.empty())
+            {
+                if (++stack.back().first != stack.back().second)
+                {
+                    descend();
+                    return;
+                }
+                stack.pop_back();
+            }
+            current = nullptr;
+        }
+
+        path const& dereference() const
+        {
+            return current->value;
+        }
+
+        bool equal(const_iterator const& rhs) const
+        {
+            return current == rhs.current;
+        }
+
+        // The position within each node's children, from the root down
+        std::vector<
+            std::pair<children_map::const_iterator, children_map::const_iterator>
+        > stack;
+        node const* current;
+    };
+    typedef const_iterator iterator;
+
+    explicit path_set(
+        boost::container::pmr::memory_resource* resource 
+        = boost::container::pmr::get_default_resource())
+        : root(resource)
     {}
 
-    void clear() { paths.clear(); }
+    path_set(std::initializer_list<path> const& x)
+        : root(boost::container::pmr::get_default_resource())
+    {
+        for (auto const& p : x)
+            insert(p);
+    }
+
+    void clear()
+    {
+        root.children.clear();
+        root.count = 0;
+        root.is_member = false;
+        root.value = path();
+    }
 
     friend bool operator==(path_set const& lhs, path_set const& rhs)
-    { return lhs.paths == rhs.paths; }
+    {
+        return lhs.size() == rhs.size() && std::equal(lhs.begin(), lhs.end(), rhs.begin());
+    }
 
-    typedef storage::value_type value_type;
-    typedef storage::const_iterator const_iterator;
-    typedef const_iterator iterator;
+    std::size_t size() const { return root.count; }
 
-    std::size_t size() const { return paths.size(); }
-    const_iterator begin() const { return paths.begin(); }
-    const_iterator end() const { return paths.end(); }
+    const_iterator begin() const
+    {
+        const_iterator result;
+        if (root.is_member)
+        {
+            result.current = &root;
+        }
+        else if (!root.children.empty())
+        {
+            result.stack.emplace_back(root.children.begin(), root.children.end());
+            result.descend();
+        }
+        return result;
+    }
+
+    const_iterator end() const { return const_iterator(); }
 
     const_iterator insert(const_iterator _, path p)
     {
@@ -40,30 +167,52 @@ class path_set
 
     const_iterator insert(path p)
     {
-        auto start = std::lower_bound(paths.begin(), paths.end(), p);
+        const_iterator result;
+        std::vector<node*> ancestors;
+        node* n = &root;
 
-        // See if a parent path is already in the set
-        if (start != paths.begin() && p.starts_with(*std::prev(start)))
-            return start;  // if so, we're done
-
-        // Find the range of paths in the set that p subsumes
-        auto finish = start;
-        while (finish != paths.end() && finish->starts_with(p))
-            ++finish;
-
-        if (start == finish)
+        std::string const& text = p.str();
+        for (std::size_t start = 0; start < text.size();)
         {
-            return paths.insert(start, p);
+            // If a parent path is already in the set, we're done
+            if (n->is_member)
+            {
+                result.current = n;
+                return result;
+            }
+
+            std::size_t finish = std::min(text.find('/', start), text.size());
+            boost::string_ref const name(text.data() + start, finish - start);
+            auto child = n->children.lower_bound(name);
+            if (child == n->children.end() || component_less()(name, child->first))
+            {
+                auto* const resource = n->children.get_allocator().resource();
+                child = n->children.emplace_hint(
+                    child, component(name.data(), name.size(), resource), node(resource));
+            }
+            result.stack.emplace_back(child, n->children.end());
+            ancestors.push_back(n);
+            n = &child->second;
+            start = finish + 1;
         }
-        else if (*start != p) // don't bother if we already have the path
+
+        // Replace everything p subsumes
+        if (!n->is_member)
         {
-            *start = std::move(p);
-            paths.erase(std::next(start), finish);
+            std::size_t const removed = n->count;
+            n->children.clear();
+            n->is_member = true;
+            n->value = std::move(p);
+            n->count = 1;
+            for (node* a : ancestors)
+                a->count = a->count + 1 - removed;
         }
-        return start;
+        result.current = n;
+        return result;
     }
+
  private:
-    storage paths;
+    node root;
 };
 
 #endif // PATH_SET_DWA2013615_HPP
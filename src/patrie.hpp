@@ -16,6 +16,8 @@
 # include <boost/range/iterator_range.hpp>
 # include <ostream>
 # include <climits>
+# include <cstdint>
+# include <unordered_map>
 
 namespace patrie_ {
 //using boost::container::vector;
@@ -71,8 +73,20 @@ struct patrie
             pos->second.data(), pos->second.data() + pos->second.size());
     }
 
+    // Write a pointer to each rule in effect at revnum to out
+    template <class OutputIterator>
+    void rules_in_effect(std::size_t revnum, OutputIterator out) const
+    {
+        for (Rule const& r : rules)
+        {
+            if (r.min <= revnum && revnum <= r.max)
+                *out++ = &r;
+        }
+    }
+
     void insert(Rule rule_)
     {
+        flat = flat_trie();
         rules.push_back(std::move(rule_));
         Rule const& rule = rules.back();
 
@@ -97,14 +111,139 @@ struct patrie
         }
     }
 
+    // Build a compact, read-only copy of the SVN path trie for
+    // longest_match to use.  Inserting another rule discards it.
+    void compile()
+    {
+        flat = flat_trie();
+        std::unordered_map<std::string, std::uint32_t> interned;
+
+        // Breadth-first, so that each node's children are adjacent
+        std::deque<std::pair<node const*, std::uint32_t> > queue(1, std::make_pair(&trie, 0u));
+        flat.nodes.resize(1);
+        flat.leading.resize(1);
+        while (!queue.empty())
+        {
+            node const& n = *queue.front().first;
+            flat_node& f = flat.nodes[queue.front().second];
+            queue.pop_front();
+
+            auto label = interned.insert(
+                std::make_pair(n.text, std::uint32_t(flat.text.size())));
+            if (label.second)
+                flat.text += n.text;
+            f.text = label.first->second;
+            f.text_size = n.text.size();
+
+            f.rules = flat.rules.size();
+            f.num_rules = n.rules.size();
+            for (Rule const* r : n.rules)
+            {
+                flat_rule const x = { std::size_t(r->min), std::size_t(r->max), r };
+                flat.rules.push_back(x);
+            }
+
+            f.children = flat.nodes.size();
+            f.num_children = n.next.size();
+            for (node const& child : n.next)
+            {
+                queue.push_back(std::make_pair(&child, std::uint32_t(flat.nodes.size())));
+                flat.nodes.push_back(flat_node());
+                flat.leading.push_back(child.text[0]);
+            }
+        }
+    }
+
     template <class Range>
     Rule const* longest_match(Range const& r, std::size_t revision) const
     {
-        search_visitor v(revision);
-        traverse(&this->trie, boost::begin(r), boost::end(r), v);
-        if (v.found_rule)
-            coverage.match(*v.found_rule, revision);
-        return v.found_rule;
+        Rule const* found_rule;
+        if (flat.nodes.empty())
+        {
+            search_visitor v(revision);
+            traverse(&this->trie, boost::begin(r), boost::end(r), v);
+            found_rule = v.found_rule;
+        }
+        else
+        {
+            cursor c = begin_search(revision);
+            advance(c, boost::begin(r), boost::end(r), revision);
+            found_rule = c.found_rule;
+        }
+        if (found_rule)
+            coverage.match(*found_rule, revision);
+        return found_rule;
+    }
+
+    // How far a longest_match search in the compiled trie has got,
+    // so that searches for paths with a common prefix can share the
+    // work of matching it.
+    struct cursor
+    {
+        std::uint32_t node;     // Within the compiled trie's nodes
+        std::uint32_t matched;  // How much of the node's text
+        bool stuck;             // Whether nothing further can match
+        Rule const* found_rule;
+    };
+
+    cursor begin_search(std::size_t revision) const
+    {
+        assert(!flat.nodes.empty() && "patrie::compile() must be called first");
+        cursor c = { 0, 0, false, flat_find_rule(flat.nodes[0], revision) };
+        return c;
+    }
+
+    // Continue the search with [start, finish), which must end on a
+    // path component boundary.
+    template <class Iterator>
+    void advance(cursor& c, Iterator start, Iterator finish, std::size_t revision) const
+    {
+        if (c.stuck)
+            return;
+
+        flat_node const* n = &flat.nodes[c.node];
+        while (start != finish)
+        {
+            if (c.matched == n->text_size)
+            {
+                char const* first = flat.leading.data() + n->children;
+                char const* last = first + n->num_children;
+                char const* p = std::lower_bound(first, last, *start);
+                if (p == last || *p != *start)
+                {
+                    c.stuck = true;
+                    return;
+                }
+                c.node = p - flat.leading.data();
+                c.matched = 0;
+                n = &flat.nodes[c.node];
+            }
+            else if (flat.text[n->text + c.matched] != *start)
+            {
+                c.stuck = true;
+                return;
+            }
+            ++c.matched;
+            ++start;
+
+            // Only record the rule on a directory boundary
+            if (c.matched == n->text_size && (start == finish || *start == '/'))
+            {
+                if (auto r = flat_find_rule(*n, revision))
+                    c.found_rule = r;
+            }
+        }
+    }
+
+    // The rule for a path whose search has reached c, and continues
+    // with the rest of the path
+    template <class Range>
+    Rule const* longest_match(cursor c, Range const& rest, std::size_t revision) const
+    {
+        advance(c, boost::begin(rest), boost::end(rest), revision);
+        if (c.found_rule)
+            coverage.match(*c.found_rule, revision);
+        return c.found_rule;
     }
   
     template <class Range, class OutputIterator>
@@ -118,7 +257,7 @@ struct patrie
     void svn_subtree_rules(Range const& svn_path, std::size_t revision, OutputIterator out) const
     {
         subtree_search_visitor<OutputIterator> v(revision, out);
-        traverse(&this->rtrie, boost::begin(svn_path), boost::end(svn_path), v);
+        traverse(&this->trie, boost::begin(svn_path), boost::end(svn_path), v);
     }
   
  private:
@@ -172,6 +311,42 @@ struct patrie
         }
     };
 
+    // The compiled trie.  nodes[0] is the root; children of a node
+    // are adjacent and sorted by their first character, which is
+    // repeated in leading so that searches touch as little memory as
+    // possible.  Each node's rules are sorted by revision range.
+    struct flat_node
+    {
+        flat_node() : text(0), text_size(0), children(0), num_children(0), rules(0), num_rules(0) {}
+        std::uint32_t text, text_size;         // Within flat_trie::text
+        std::uint32_t children, num_children;  // Within flat_trie::nodes
+        std::uint32_t rules, num_rules;        // Within flat_trie::rules
+    };
+
+    struct flat_rule
+    {
+        std::size_t min, max;
+        Rule const* rule;
+    };
+
+    struct flat_trie
+    {
+        std::vector<flat_node> nodes;
+        std::vector<char> leading;
+        std::string text;
+        std::vector<flat_rule> rules;
+    };
+
+    Rule const* flat_find_rule(flat_node const& n, std::size_t revnum) const
+    {
+        flat_rule const* first = flat.rules.data() + n.rules;
+        flat_rule const* last = first + n.num_rules;
+        flat_rule const* p = std::lower_bound(
+            first, last, revnum, 
+            [](flat_rule const& r, std::size_t revision) { return r.max < revision; });
+        return (p != last && p->min <= revnum) ? p->rule : 0;
+    }
+
     struct rule_rev_comparator
     {
         bool operator()(Rule const* r, std::size_t revision) const
@@ -303,6 +478,18 @@ struct patrie
         subtree_search_visitor(std::size_t revision, OutputIterator out)
             : search_visitor_base(revision), out(out) {}
 
+        // We matched up through position c in node n
+        template <class Iterator>
+        void partial_match(
+            node const &n, std::string::const_iterator c, 
+            Iterator start, Iterator finish)
+        {
+            // If the input ran out on a boundary within n, everything
+            // from n on down is in the subtree
+            if (start == finish && (*c == '/' || c[-1] == ':'))
+                full_match(n, start, finish, false);
+        }
+
         // We matched all of node n
         template <class Iterator>
         void full_match(node const& n, Iterator start, Iterator finish, bool slash_required = true)
@@ -316,8 +503,11 @@ struct patrie
                 
                 // Make sure we're only finding subtrees by requiring
                 // a slash at the boundary between the full match and
-                // everything else.
-                slash_required = slash_required && n.text[n.text.size() - 1] != '/';
+                // everything else.  The root of an SVN path, or of
+                // the tree in a Git address ("repo:ref:"), already
+                // is such a boundary.
+                slash_required = slash_required && !n.text.empty()
+                    && n.text[n.text.size() - 1] != '/' && n.text[n.text.size() - 1] != ':';
                 for (auto const& n1 : n.next)
                 {
                     if (!slash_required || n1.text[0] == '/')
@@ -400,6 +590,7 @@ struct patrie
     node rtrie;
     mutable Coverage coverage;
     std::vector<rev_rules> transition_map;
+    flat_trie flat;
 };
 }
 using patrie_::patrie;
@@ -0,0 +1,294 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#include "pipe_writer.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <cerrno>
+#include <cstring>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+struct pipe_writer::impl
+{
+    impl(int fd, std::size_t capacity)
+        : fd(fd), capacity(capacity), queued_bytes(0), closing(false),
+          bytes_written(0), seconds_blocked(0),
+          thread([this]{ run(); })
+    {}
+
+    ~impl()
+    {
+        close();
+    }
+
+    // What's queued: bytes, or a region of a file to be spliced in
+    struct chunk
+    {
+        std::size_t size() const { return region.fd ? region.size : data.size(); }
+
+        std::string data;
+        file_region region;
+    };
+
+    void run();
+    std::string write_all(std::vector<chunk> const& chunks);
+    std::string write_pieces(iovec* p, iovec* e);
+    std::string write_region(file_region const& region);
+    std::string copy_region(int in, std::uint64_t offset, std::uint64_t left);
+    void wait_for_room(std::unique_lock<std::mutex>& lock);
+    void close();
+
+    int fd;
+    std::size_t const capacity;
+
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+
+    // Small writes are appended to the last chunk rather than
+    // queued separately
+    std::deque<chunk> chunks;
+    std::size_t queued_bytes;
+    bool closing;
+    std::string error;  // Set if writing to fd failed
+
+    std::uint64_t bytes_written;
+    double seconds_blocked;
+
+    std::thread thread;
+};
+
+// Chunks are coalesced up to this size
+static std::size_t const chunk_size = 64 * 1024;
+
+// How many queued chunks are written with one system call
+static std::size_t const max_batch = 16;
+
+void pipe_writer::impl::run()
+{
+    std::vector<chunk> batch;
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true)
+    {
+        not_empty.wait(lock, [this]{ return closing || !chunks.empty(); });
+        if (chunks.empty())
+            return;
+
+        batch.clear();
+        std::size_t batch_bytes = 0;
+        while (!chunks.empty() && batch.size() < max_batch)
+        {
+            batch_bytes += chunks.front().size();
+            batch.push_back(std::move(chunks.front()));
+            chunks.pop_front();
+        }
+        bool const failed = !error.empty();
+        lock.unlock();
+
+        // Once writing has failed, just discard what's queued
+        std::string write_error;
+        if (!failed)
+            write_error = write_all(batch);
+
+        lock.lock();
+        if (!write_error.empty() && error.empty())
+            error = std::move(write_error);
+        queued_bytes -= batch_bytes;
+        not_full.notify_all();
+    }
+}
+
+// Write all of the chunks to fd, returning a description of what
+// went wrong, if anything
+std::string pipe_writer::impl::write_all(std::vector<chunk> const& chunks)
+{
+    iovec pieces[max_batch];
+    std::size_t n_pieces = 0;
+    for (auto const& c : chunks)
+    {
+        if (!c.region.fd)
+        {
+            pieces[n_pieces++] = iovec{const_cast<char*>(c.data.data()), c.data.size()};
+            continue;
+        }
+
+        std::string error = write_pieces(pieces, pieces + n_pieces);
+        if (error.empty())
+            error = write_region(c.region);
+        if (!error.empty())
+            return error;
+        n_pieces = 0;
+    }
+    return write_pieces(pieces, pieces + n_pieces);
+}
+
+// Write the bytes described by [p, e), returning a description of
+// what went wrong, if anything
+std::string pipe_writer::impl::write_pieces(iovec* p, iovec* e)
+{
+    while (p != e)
+    {
+        ssize_t n = ::writev(fd, p, e - p);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return std::strerror(errno);
+        }
+
+        // Skip what was written, which may end partway through a piece
+        for (; p != e && std::size_t(n) >= p->iov_len; ++p)
+            n -= p->iov_len;
+        if (p != e)
+        {
+            p->iov_base = static_cast<char*>(p->iov_base) + n;
+            p->iov_len -= n;
+        }
+    }
+    return std::string();
+}
+
+// Move the region's bytes into the pipe without copying them
+// through user space, if the kernel can
+std::string pipe_writer::impl::write_region(file_region const& region)
+{
+    loff_t offset = region.offset;
+    for (std::uint64_t left = region.size; left > 0;)
+    {
+        ssize_t const n = ::splice(*region.fd, &offset, fd, nullptr, left, SPLICE_F_MORE);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            if (errno == EINVAL || errno == ENOSYS)
+                return copy_region(*region.fd, offset, left);
+            return std::strerror(errno);
+        }
+        if (n == 0)
+            return "unexpected end of file";
+        left -= n;
+    }
+    return std::string();
+}
+
+// Copy bytes from a file the ordinary way, for when they can't be
+// spliced
+std::string pipe_writer::impl::copy_region(int in, std::uint64_t offset, std::uint64_t left)
+{
+    std::vector<char> buffer(std::min<std::uint64_t>(left, chunk_size));
+    while (left > 0)
+    {
+        ssize_t const n = ::pread(
+            in, buffer.data(), std::min<std::uint64_t>(left, buffer.size()), offset);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return std::strerror(errno);
+        }
+        if (n == 0)
+            return "unexpected end of file";
+
+        iovec piece = { buffer.data(), std::size_t(n) };
+        std::string const error = write_pieces(&piece, &piece + 1);
+        if (!error.empty())
+            return error;
+        offset += n;
+        left -= n;
+    }
+    return std::string();
+}
+
+void pipe_writer::impl::close()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (closing)
+            return;
+        closing = true;
+    }
+    not_empty.notify_all();
+    thread.join();
+    ::close(fd);
+}
+
+pipe_writer::pipe_writer(int fd, std::size_t capacity)
+    : pimpl(std::make_shared<impl>(fd, capacity))
+{}
+
+void pipe_writer::impl::wait_for_room(std::unique_lock<std::mutex>& lock)
+{
+    auto const ready = [this]{ return queued_bytes < capacity || !error.empty(); };
+    if (!ready())
+    {
+        auto const start = std::chrono::steady_clock::now();
+        not_full.wait(lock, ready);
+        seconds_blocked += std::chrono::duration<double>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+    if (!error.empty())
+        throw std::runtime_error("write to pipe failed: " + error);
+}
+
+std::streamsize pipe_writer::write(char const* s, std::streamsize n)
+{
+    impl& x = *pimpl;
+    std::unique_lock<std::mutex> lock(x.mutex);
+    x.wait_for_room(lock);
+
+    if (x.chunks.empty() || x.chunks.back().region.fd 
+        || x.chunks.back().data.size() + n > chunk_size)
+    {
+        x.chunks.emplace_back();
+    }
+    x.chunks.back().data.append(s, n);
+    x.queued_bytes += n;
+    x.bytes_written += n;
+
+    lock.unlock();
+    x.not_empty.notify_one();
+    return n;
+}
+
+void pipe_writer::write_region(file_region const& region)
+{
+    impl& x = *pimpl;
+    std::unique_lock<std::mutex> lock(x.mutex);
+    x.wait_for_room(lock);
+
+    x.chunks.emplace_back();
+    x.chunks.back().region = region;
+    x.queued_bytes += region.size;
+    x.bytes_written += region.size;
+
+    lock.unlock();
+    x.not_empty.notify_one();
+}
+
+void pipe_writer::close()
+{
+    pimpl->close();
+}
+
+std::uint64_t pipe_writer::bytes_written() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    return pimpl->bytes_written;
+}
+
+double pipe_writer::seconds_blocked() const
+{
+    std::lock_guard<std::mutex> lock(pimpl->mutex);
+    return pimpl->seconds_blocked;
+}
@@ -0,0 +1,44 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef PIPE_WRITER_DWA2013724_HPP
+# define PIPE_WRITER_DWA2013724_HPP
+
+# include "file_region.hpp"
+# include <cstdint>
+# include <iosfwd>
+# include <memory>
+
+// Queues whatever is written to it for a dedicated thread to write to
+// a file descriptor, which it owns.  Writers block only while more
+// than capacity bytes are waiting, so a slow reader on the other end
+// holds up nobody until its queue fills.  If writing to the
+// descriptor fails, the next write (or write_region) throws.
+class pipe_writer
+{
+ public:
+    pipe_writer(int fd, std::size_t capacity);
+
+    std::streamsize write(char const* s, std::streamsize n);
+
+    // Queue the bytes of region, to be spliced into the file
+    // descriptor when their turn comes.  The region's file is kept
+    // open until then.
+    void write_region(file_region const& region);
+
+    // Waits for everything queued to be written, then closes the
+    // file descriptor.
+    void close();
+
+    // Everything ever written
+    std::uint64_t bytes_written() const;
+
+    // How long writers have waited for the queue to drain
+    double seconds_blocked() const;
+
+ private:
+    struct impl;
+    std::shared_ptr<impl> pimpl;  // Shared by copies
+};
+
+#endif // PIPE_WRITER_DWA2013724_HPP
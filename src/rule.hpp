@@ -21,7 +21,11 @@ struct Rule
           branch_rule(branch_rule),
           content_rule(content_rule),
           min(std::max(branch_rule->min, repo_rule->minrev)),
-          max(std::min(branch_rule->max, repo_rule->maxrev))
+          max(std::min(branch_rule->max, repo_rule->maxrev)),
+          svn_path_(
+              content_rule
+              ? branch_rule->svn_path / content_rule->svn_path
+              : branch_rule->svn_path)
     {}
 
     // Constituent rules in the AST
@@ -40,11 +44,11 @@ struct Rule
             && lhs.max == rhs.max;
     }
 
-    path svn_path() const
+    // Matching a path refers to this for every file converted, so it
+    // is computed once
+    path const& svn_path() const
     {
-        return content_rule
-            ? branch_rule->svn_path / content_rule->svn_path
-            : branch_rule->svn_path;
+        return svn_path_;
     }
 
     std::string git_address() const
@@ -57,15 +61,19 @@ struct Rule
         return repo_rule->git_repo_name;
     }
 
-    path git_path() const
+    path const& git_path() const
     {
-        return content_rule ? content_rule->git_path : path();
+        static path const root;
+        return content_rule ? content_rule->git_path : root;
     }
 
     std::string git_ref_name() const
     {
         return boost2git::git_ref_name(branch_rule);
     }
+
+ private:
+    path svn_path_;
 };
 
 void report_overlap(Rule const* rule0, Rule const* rule1);
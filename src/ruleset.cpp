@@ -125,6 +125,7 @@ Ruleset::Ruleset(std::string const& filename)
       }
     repositories_.push_back(repo);
     }
+  matcher_.compile();
   }
 
 void report_overlap(Rule const* rule0, Rule const* rule1)
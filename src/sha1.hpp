@@ -0,0 +1,155 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef SHA1_DWA2013723_HPP
+# define SHA1_DWA2013723_HPP
+
+# include <algorithm>
+# include <array>
+# include <cstdint>
+# include <cstring>
+# include <string>
+
+// A plain SHA-1 implementation, used to compute the names Git gives
+// to objects without asking Git.
+class sha1
+{
+ public:
+    typedef std::array<unsigned char, 20> digest_type;
+
+    sha1() : length(0), buffered(0)
+    {
+        h[0] = 0x67452301; h[1] = 0xEFCDAB89; h[2] = 0x98BADCFE;
+        h[3] = 0x10325476; h[4] = 0xC3D2E1F0;
+    }
+
+    sha1& update(void const* data, std::size_t size)
+    {
+        auto p = static_cast<unsigned char const*>(data);
+        length += size;
+        if (buffered)
+        {
+            std::size_t n = std::min(size, sizeof(block) - buffered);
+            std::memcpy(block + buffered, p, n);
+            buffered += n;
+            p += n;
+            size -= n;
+            if (buffered < sizeof(block))
+                return *this;
+            process(block);
+            buffered = 0;
+        }
+        for (; size >= sizeof(block); p += sizeof(block), size -= sizeof(block))
+            process(p);
+        std::memcpy(block, p, size);
+        buffered = size;
+        return *this;
+    }
+
+    sha1& update(std::string const& s)
+    {
+        return update(s.data(), s.size());
+    }
+
+    digest_type digest() const
+    {
+        sha1 x(*this);
+        std::uint64_t const bits = x.length * 8;
+        unsigned char pad[128] = { 0x80 };
+        std::size_t npad = (x.buffered < 56 ? 56 : 120) - x.buffered;
+        for (int i = 0; i < 8; ++i)
+            pad[npad + i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        x.update(pad, npad + 8);
+
+        digest_type result;
+        for (int i = 0; i < 20; ++i)
+            result[i] = static_cast<unsigned char>(x.h[i / 4] >> (24 - 8 * (i % 4)));
+        return result;
+    }
+
+    std::string hex_digest() const
+    {
+        return to_hex(digest());
+    }
+
+    static std::string to_hex(digest_type const& d)
+    {
+        static char const digits[] = "0123456789abcdef";
+        std::string result(40, '0');
+        for (int i = 0; i < 20; ++i)
+        {
+            result[2 * i] = digits[d[i] >> 4];
+            result[2 * i + 1] = digits[d[i] & 0xF];
+        }
+        return result;
+    }
+
+    // The inverse of to_hex; h must hold 40 hex digits
+    static digest_type from_hex(std::string const& h)
+    {
+        digest_type result;
+        for (int i = 0; i < 20; ++i)
+            result[i] = static_cast<unsigned char>(hex_value(h[2 * i]) << 4 | hex_value(h[2 * i + 1]));
+        return result;
+    }
+
+ private:
+    static int hex_value(char c)
+    {
+        return c <= '9' ? c - '0' : (c | 0x20) - 'a' + 10;
+    }
+
+    static std::uint32_t rol(std::uint32_t x, int n)
+    {
+        return (x << n) | (x >> (32 - n));
+    }
+
+    void process(unsigned char const* p)
+    {
+        std::uint32_t w[80];
+        for (int i = 0; i < 16; ++i)
+            w[i] = std::uint32_t(p[4*i]) << 24 | std::uint32_t(p[4*i+1]) << 16
+                 | std::uint32_t(p[4*i+2]) << 8 | std::uint32_t(p[4*i+3]);
+        for (int i = 16; i < 80; ++i)
+            w[i] = rol(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+
+        std::uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+        for (int i = 0; i < 80; ++i)
+        {
+            std::uint32_t f, k;
+            if (i < 20)      { f = (b & c) | (~b & d);          k = 0x5A827999; }
+            else if (i < 40) { f = b ^ c ^ d;                   k = 0x6ED9EBA1; }
+            else if (i < 60) { f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; }
+            else             { f = b ^ c ^ d;                   k = 0xCA62C1D6; }
+            std::uint32_t t = rol(a, 5) + f + e + k + w[i];
+            e = d; d = c; c = rol(b, 30); b = a; a = t;
+        }
+        h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+    }
+
+ private:
+    std::uint32_t h[5];
+    std::uint64_t length;
+    unsigned char block[64];
+    std::size_t buffered;
+};
+
+// Incrementally computes the SHA-1 under which Git stores an object
+// of the given type ("blob", "tree", "commit") and size.
+struct git_object_hasher : sha1
+{
+    git_object_hasher(char const* type, std::size_t size)
+    {
+        std::string header = std::string(type) + " " + std::to_string(size);
+        update(header.c_str(), header.size() + 1); // include the NUL
+    }
+};
+
+inline std::string git_blob_sha(char const* data, std::size_t size)
+{
+    git_object_hasher h("blob", size);
+    h.update(data, size);
+    return h.hex_digest();
+}
+
+#endif // SHA1_DWA2013723_HPP
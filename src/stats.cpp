@@ -0,0 +1,120 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#include "stats.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <iomanip>
+#include <ostream>
+#include <time.h>
+
+static stats::totals phase_totals[stats::num_phases];
+static std::uint64_t revisions;
+static double const start_time = stats::wall_clock();
+
+double stats::wall_clock()
+{
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double stats::cpu_clock()
+{
+    timespec t;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t) != 0)
+        return 0;
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+stats::timer::timer(phase p)
+    : p(p), wall_start(wall_clock()), cpu_start(cpu_clock())
+{}
+
+stats::timer::~timer()
+{
+    totals& t = phase_totals[p];
+    t.wall_seconds += wall_clock() - wall_start;
+    t.cpu_seconds += cpu_clock() - cpu_start;
+    t.count += 1;
+}
+
+char const* stats::name(phase p)
+{
+    static char const* const names[num_phases] =
+    {
+        "rule_transitions", "svn_changes", "merge_discovery", "prefetching",
+        "first_pass", "later_passes", "commit_closing"
+    };
+    return names[p];
+}
+
+stats::totals const& stats::total(phase p)
+{
+    return phase_totals[p];
+}
+
+void stats::count_revision()
+{
+    ++revisions;
+}
+
+std::ostream& stats::report_progress(std::ostream& os)
+{
+    os << std::fixed << std::setprecision(1)
+       << revisions << " revisions in " << wall_clock() - start_time << "s:";
+    for (int p = 0; p < num_phases; ++p)
+        os << " " << name(phase(p)) << "=" << phase_totals[p].wall_seconds << "s";
+    os.unsetf(std::ios::floatfield);
+    return os;
+}
+
+// Repository names are paths, which may contain anything
+static std::string json_string(std::string const& s)
+{
+    std::string result = "\"";
+    for (char c : s)
+    {
+        if (c == '"' || c == '\\')
+            result += '\\';
+        if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char buf[8];
+            std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+            result += buf;
+        }
+        else
+            result += c;
+    }
+    return result + "\"";
+}
+
+void stats::report(std::ostream& os, std::vector<repository> const& repositories)
+{
+    os << std::setprecision(6) << std::fixed
+       << "{\n"
+       << "  \"revisions\": " << revisions << ",\n"
+       << "  \"wall_seconds\": " << wall_clock() - start_time << ",\n"
+       << "  \"phases\": {";
+    for (int p = 0; p < num_phases; ++p)
+    {
+        totals const& t = phase_totals[p];
+        os << (p ? "," : "") << "\n    " << json_string(name(phase(p)))
+           << ": {\"wall_seconds\": " << t.wall_seconds
+           << ", \"cpu_seconds\": " << t.cpu_seconds
+           << ", \"count\": " << t.count << "}";
+    }
+    os << "\n  },\n"
+       << "  \"repositories\": {";
+    for (std::size_t i = 0; i < repositories.size(); ++i)
+    {
+        repository const& r = repositories[i];
+        os << (i ? "," : "") << "\n    " << json_string(r.name)
+           << ": {\"bytes_written\": " << r.bytes_written
+           << ", \"write_blocked_seconds\": " << r.write_blocked_seconds
+           << ", \"ls_wait_seconds\": " << r.ls_wait_seconds << "}";
+    }
+    os << "\n  }\n"
+       << "}\n";
+    os.unsetf(std::ios::floatfield);
+}
@@ -0,0 +1,72 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef STATS_DWA2013727_HPP
+# define STATS_DWA2013727_HPP
+
+# include <cstdint>
+# include <iosfwd>
+# include <string>
+# include <vector>
+
+// Where the time goes in an import: wall-clock and CPU time for each
+// phase of import_revision, accumulated over the whole run.  CPU time
+// is that of the importing thread only.
+struct stats
+{
+    enum phase
+    {
+        rule_transitions,
+        svn_changes,
+        merge_discovery,
+        prefetching,
+        first_pass,       // Conversion passes over the SVN paths...
+        later_passes,     // ...of which there may be more than one
+        commit_closing,   // Including waits for fast-import's "ls" responses
+        num_phases
+    };
+
+    struct totals
+    {
+        totals() : wall_seconds(0), cpu_seconds(0), count(0) {}
+        double wall_seconds;
+        double cpu_seconds;
+        std::uint64_t count;
+    };
+
+    // Charges the time spent during its lifetime to a phase
+    class timer
+    {
+     public:
+        explicit timer(phase p);
+        ~timer();
+     private:
+        phase p;
+        double wall_start;
+        double cpu_start;
+    };
+
+    // What was sent to one Git repository
+    struct repository
+    {
+        std::string name;
+        std::uint64_t bytes_written;
+        double write_blocked_seconds;  // Waiting for room in the queue
+        double ls_wait_seconds;        // Waiting for "ls" responses
+    };
+
+    static char const* name(phase p);
+    static totals const& total(phase p);
+    static void count_revision();
+
+    // A one-line summary, for the log
+    static std::ostream& report_progress(std::ostream& os);
+
+    // Everything, as a JSON object
+    static void report(std::ostream& os, std::vector<repository> const& repositories);
+
+    static double wall_clock();
+    static double cpu_clock();
+};
+
+#endif // STATS_DWA2013727_HPP
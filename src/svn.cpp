@@ -34,16 +34,29 @@
 #include <boost/date_time/posix_time/time_parsers.hpp>
 #include <boost/date_time/posix_time/posix_time_io.hpp>
 
+#include <algorithm>
+#include <exception>
+#include <limits>
+
 AprInit apr_init;
 AprPool svn::global_pool;
 
+// The number of directory listings to keep
+static std::size_t const directory_cache_size = 1 << 16;
+
 svn::svn(
     std::string const& repo_path,
     std::string const& authors_file_path)
-    : repos(call(svn_repos_open, repo_path.c_str(), global_pool)),
+    : repo_path(repo_path),
+      repos(call(svn_repos_open, repo_path.c_str(), global_pool)),
       fs(svn_repos_fs(repos)),
-      authors(authors_file_path)
+      authors(authors_file_path),
+      directories(directory_cache_size),
+      loaded_files_revnum(-1)
 {
+    // Let a failed assertion within libsvn surface as an error
+    // rather than abort the conversion
+    svn_error_set_malfunction_handler(svn_error_raise_on_malfunction);
 }
 
 svn::~svn()
@@ -54,6 +67,299 @@ int svn::latest_revision() const
     return call(svn_fs_youngest_rev, fs, global_pool);
 }
 
+void svn::create(std::string const& repo_path)
+{
+    AprPool pool = global_pool.make_subpool();
+    svn_repos_t* repos;
+    check_svn(
+        svn_repos_create(&repos, repo_path.c_str(), nullptr, nullptr, nullptr, nullptr, pool));
+}
+
+namespace
+{
+  // The contents of files carried in full by the revision being
+  // loaded are kept in memory until it has been converted, up to
+  // this many bytes; the rest are read back from the repository.
+  std::size_t const loaded_files_budget = 256 << 20;
+
+  // Passes the dump on to the parser that loads it into the
+  // repository, keeping the full texts of the files it carries
+  struct dump_loader
+  {
+      std::function<bool(int)> const* revision_loaded;
+
+      svn_repos_parse_fns3_t const* fs_parser;
+      void* fs_parse_baton;
+
+      svn::loaded_file_map* files;
+      int* files_revnum;
+      std::size_t file_bytes;
+
+      // Set once revision_loaded has returned false
+      bool stopped;
+
+      // Whatever revision_loaded threw; it can't propagate through
+      // the SVN library
+      std::exception_ptr error;
+  };
+
+  struct revision_baton
+  {
+      dump_loader* loader;
+      void* fs_baton;
+  };
+
+  struct node_baton
+  {
+      dump_loader* loader;
+      void* fs_baton;
+      char const* path;    // Without a leading slash, or null
+      std::string* text;   // Where the file's full text goes, or null
+      apr_pool_t* pool;
+  };
+
+  // The key for path in an svn::loaded_file_map
+  char const* loaded_file_key(char const* path)
+  {
+      return *path == '/' ? path + 1 : path;
+  }
+}
+
+extern "C"
+{
+    static void notify_loaded(void* baton, svn_repos_notify_t const* notify, apr_pool_t*)
+    {
+        dump_loader& loader = *static_cast<dump_loader*>(baton);
+        if (notify->action != svn_repos_notify_load_txn_committed 
+            || loader.stopped || loader.error)
+            return;
+
+        try
+        {
+            *loader.files_revnum = notify->new_revision;
+            loader.stopped = !(*loader.revision_loaded)(notify->new_revision);
+        }
+        catch (...)
+        {
+            loader.error = std::current_exception();
+        }
+        *loader.files_revnum = -1;
+        loader.files->clear();
+        loader.file_bytes = 0;
+    }
+
+    // Stop reading the dump once revision_loaded has failed or asked
+    // for no more
+    static svn_error_t* check_loader(void* baton)
+    {
+        dump_loader const& loader = *static_cast<dump_loader*>(baton);
+        if (loader.stopped || loader.error)
+            return svn_error_create(SVN_ERR_CANCELLED, nullptr, "stopped loading the dump");
+        return SVN_NO_ERROR;
+    }
+
+    static svn_error_t* magic_header_record(int version, void* parse_baton, apr_pool_t* pool)
+    {
+        dump_loader& loader = *static_cast<dump_loader*>(parse_baton);
+        return loader.fs_parser->magic_header_record(version, loader.fs_parse_baton, pool);
+    }
+
+    static svn_error_t* uuid_record(char const* uuid, void* parse_baton, apr_pool_t* pool)
+    {
+        dump_loader& loader = *static_cast<dump_loader*>(parse_baton);
+        return loader.fs_parser->uuid_record(uuid, loader.fs_parse_baton, pool);
+    }
+
+    static svn_error_t* new_revision_record(
+        void** baton, apr_hash_t* headers, void* parse_baton, apr_pool_t* pool)
+    {
+        dump_loader& loader = *static_cast<dump_loader*>(parse_baton);
+        loader.files->clear();
+        loader.file_bytes = 0;
+
+        // The parser commits the previous revision just before asking
+        // for this one.  If that was the last one wanted, stop before
+        // a transaction is begun for this one.
+        SVN_ERR(check_loader(&loader));
+
+        revision_baton* rb = static_cast<revision_baton*>(apr_palloc(pool, sizeof(revision_baton)));
+        rb->loader = &loader;
+        SVN_ERR(
+            loader.fs_parser->new_revision_record(
+                &rb->fs_baton, headers, loader.fs_parse_baton, pool));
+        *baton = rb;
+        return SVN_NO_ERROR;
+    }
+
+    static svn_error_t* new_node_record(
+        void** baton, apr_hash_t* headers, void* revision_baton_, apr_pool_t* pool)
+    {
+        revision_baton& rb = *static_cast<revision_baton*>(revision_baton_);
+        node_baton* nb = static_cast<node_baton*>(apr_palloc(pool, sizeof(node_baton)));
+        nb->loader = rb.loader;
+        nb->text = nullptr;
+        nb->pool = pool;
+        nb->path = static_cast<char const*>(
+            apr_hash_get(headers, SVN_REPOS_DUMPFILE_NODE_PATH, APR_HASH_KEY_STRING));
+        if (nb->path)
+        {
+            nb->path = apr_pstrdup(pool, loaded_file_key(nb->path));
+            // Whatever an earlier record said about this path is
+            // superseded
+            auto superseded = rb.loader->files->find(nb->path);
+            if (superseded != rb.loader->files->end())
+            {
+                rb.loader->file_bytes -= superseded->second.size();
+                rb.loader->files->erase(superseded);
+            }
+        }
+        SVN_ERR(rb.loader->fs_parser->new_node_record(&nb->fs_baton, headers, rb.fs_baton, pool));
+        *baton = nb;
+        return SVN_NO_ERROR;
+    }
+
+    static svn_error_t* set_revision_property(
+        void* baton, char const* name, svn_string_t const* value)
+    {
+        revision_baton& rb = *static_cast<revision_baton*>(baton);
+        return rb.loader->fs_parser->set_revision_property(rb.fs_baton, name, value);
+    }
+
+    static svn_error_t* set_node_property(void* baton, char const* name, svn_string_t const* value)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        return nb.loader->fs_parser->set_node_property(nb.fs_baton, name, value);
+    }
+
+    static svn_error_t* delete_node_property(void* baton, char const* name)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        return nb.loader->fs_parser->delete_node_property(nb.fs_baton, name);
+    }
+
+    static svn_error_t* remove_node_props(void* baton)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        return nb.loader->fs_parser->remove_node_props(nb.fs_baton);
+    }
+
+    // Append to the node's full text, or give up on keeping it once
+    // the budget runs out
+    static svn_error_t* write_loaded_file(void* baton, char const* data, apr_size_t* len)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        dump_loader& loader = *nb.loader;
+        if (!nb.text)
+            return SVN_NO_ERROR;
+
+        if (loader.file_bytes + *len > loaded_files_budget)
+        {
+            loader.file_bytes -= nb.text->size();
+            loader.files->erase(nb.path);
+            nb.text = nullptr;
+            return SVN_NO_ERROR;
+        }
+        nb.text->append(data, *len);
+        loader.file_bytes += *len;
+        return SVN_NO_ERROR;
+    }
+
+    static svn_error_t* set_fulltext(svn_stream_t** stream, void* baton)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        SVN_ERR(nb.loader->fs_parser->set_fulltext(stream, nb.fs_baton));
+
+        // A null stream means the loader is skipping this node
+        if (*stream && nb.path)
+        {
+            nb.text = &(*nb.loader->files)[nb.path];
+            svn_stream_t* copy = svn_stream_create(&nb, nb.pool);
+            svn_stream_set_write(copy, write_loaded_file);
+            *stream = svn_stream_tee(*stream, copy, nb.pool);
+        }
+        return SVN_NO_ERROR;
+    }
+
+    // Deltas are applied by the repository, which we leave to supply
+    // the result
+    static svn_error_t* apply_textdelta(
+        svn_txdelta_window_handler_t* handler, void** handler_baton, void* baton)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        return nb.loader->fs_parser->apply_textdelta(handler, handler_baton, nb.fs_baton);
+    }
+
+    static svn_error_t* close_node(void* baton)
+    {
+        node_baton& nb = *static_cast<node_baton*>(baton);
+        return nb.loader->fs_parser->close_node(nb.fs_baton);
+    }
+
+    static svn_error_t* close_revision(void* baton)
+    {
+        revision_baton& rb = *static_cast<revision_baton*>(baton);
+        return rb.loader->fs_parser->close_revision(rb.fs_baton);
+    }
+}
+
+void svn::load_dump(
+    std::string const& dump_path, 
+    std::function<bool(int)> const& revision_loaded)
+{
+    AprPool pool = global_pool.make_subpool();
+
+    svn_stream_t* dump;
+    if (dump_path == "-")
+        check_svn(svn_stream_for_stdin(&dump, pool));
+    else
+        check_svn(svn_stream_open_readonly(&dump, dump_path.c_str(), pool, pool));
+
+    dump_loader loader = {
+        &revision_loaded, nullptr, nullptr, &loaded_files, &loaded_files_revnum, 0, false, nullptr };
+
+    // Loading starts just after what we already have, and goes on to
+    // the end of the dump.  The loader wants either both bounds or
+    // neither.
+    check_svn(
+        svn_repos_get_fs_build_parser4(
+            &loader.fs_parser, &loader.fs_parse_baton, repos,
+            latest_revision() + 1, std::numeric_limits<svn_revnum_t>::max(),
+            TRUE,                                      // Keep copy history
+            FALSE,                                     // Don't validate properties
+            svn_repos_load_uuid_default, nullptr,
+            notify_loaded, &loader, pool));
+
+    svn_repos_parse_fns3_t parser = {};
+    parser.magic_header_record = magic_header_record;
+    parser.uuid_record = uuid_record;
+    parser.new_revision_record = new_revision_record;
+    parser.new_node_record = new_node_record;
+    parser.set_revision_property = set_revision_property;
+    parser.set_node_property = set_node_property;
+    parser.delete_node_property = delete_node_property;
+    parser.remove_node_props = remove_node_props;
+    parser.set_fulltext = set_fulltext;
+    parser.apply_textdelta = apply_textdelta;
+    parser.close_node = close_node;
+    parser.close_revision = close_revision;
+
+    svn_error_t* err = svn_repos_parse_dumpstream3(
+        dump, &parser, &loader, FALSE, check_loader, &loader, pool);
+    loaded_files.clear();
+    loaded_files_revnum = -1;
+    if (loader.error)
+    {
+        svn_error_clear(err);
+        std::rethrow_exception(loader.error);
+    }
+    if (loader.stopped && err && err->apr_err == SVN_ERR_CANCELLED)
+    {
+        svn_error_clear(err);
+        return;
+    }
+    check_svn(err);
+}
+
 static std::string get_string(apr_hash_t *revprops, char const *key)
 {
     std::string result;
@@ -66,7 +372,8 @@ static std::string get_string(apr_hash_t *revprops, char const *key)
 }
 
 svn::revision::revision(svn const& repo, int revnum)
-    : pool(svn::global_pool.make_subpool())
+    : repo(repo)
+    , pool(svn::global_pool.make_subpool())
     , fs_root(call(svn_fs_revision_root, repo.fs, revnum, pool))
     , revnum(revnum)
     , epoch(0)
@@ -91,3 +398,37 @@ svn::revision::revision(svn const& repo, int revnum)
     if (log_message.empty())
         log_message = "** empty log message **";
 }
+
+std::shared_ptr<svn::directory const> svn::revision::entries(
+    char const* dir_path, std::string const& dir_id) const
+{
+    if (auto const* cached = repo.directories.find(dir_id))
+        return *cached;
+
+    AprPool scope = pool.make_subpool();
+    apr_hash_t* entries = call(svn_fs_dir_entries, fs_root, dir_path, scope);
+
+    auto result = std::make_shared<directory>();
+    result->reserve(apr_hash_count(entries));
+    for (apr_hash_index_t* i = apr_hash_first(scope, entries); i; i = apr_hash_next(i))
+    {
+        void* value;
+        apr_hash_this(i, nullptr, nullptr, &value);
+        svn_fs_dirent_t const* entry = static_cast<svn_fs_dirent_t const*>(value);
+        svn_string_t const* id = svn_fs_unparse_id(entry->id, scope);
+        result->push_back(dirent{entry->name, entry->kind, std::string(id->data, id->len)});
+    }
+    std::sort(
+        result->begin(), result->end(), 
+        [](dirent const& lhs, dirent const& rhs) { return lhs.name < rhs.name; });
+
+    return repo.directories.insert(dir_id, std::move(result));
+}
+
+std::string const* svn::revision::loaded_file(char const* file_path) const
+{
+    if (revnum != repo.loaded_files_revnum)
+        return nullptr;
+    auto p = repo.loaded_files.find(loaded_file_key(file_path));
+    return p == repo.loaded_files.end() ? nullptr : &p->second;
+}
@@ -22,11 +22,16 @@
 #include "apr_pool.hpp"
 #include "authors.hpp"
 #include "svn_error.hpp"
+#include "lru_cache.hpp"
 
 #include <svn_fs.h>
 #include <svn_repos.h>
 
+#include <functional>
+#include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class Authors;
 
@@ -39,6 +44,22 @@ class svn
 
     int latest_revision() const;
 
+    // Create an empty repository at repo_path
+    static void create(std::string const& repo_path);
+
+    // Load the "svnadmin dump" stream in the file at dump_path ("-"
+    // for stdin) into this repository, passing each revision's number
+    // to revision_loaded as soon as it is committed.  Loading stops
+    // when revision_loaded returns false.  Revisions the repository
+    // already has are skipped, so a dump of the whole history can be
+    // fed to a partly loaded repository.  While
+    // revision_loaded runs, the files whose full text the dump
+    // carried for that revision are available from
+    // revision::loaded_file.
+    void load_dump(
+        std::string const& dump_path, 
+        std::function<bool(int)> const& revision_loaded);
+
     // Call an SVN function with proper error reporting
     template <class R, class...P, class...A>
     static R call(svn_error_t* (*f)(R*, P...), A const& ...args)
@@ -48,10 +69,31 @@ class svn
         return result;
     }
 
+    struct dirent
+    {
+        std::string name;
+        svn_node_kind_t kind;
+        std::string id;        // The node-revision id
+    };
+    typedef std::vector<dirent> directory;
+
     struct revision
     {
         revision(svn const& repo, int revnum);
 
+        // The entries, sorted by name, of the directory at dir_path,
+        // whose node-revision id is dir_id.  A node-revision never
+        // changes, so listings are cached by id and an unchanged
+        // directory is read from SVN just once, however many
+        // revisions and passes visit it.
+        std::shared_ptr<directory const> entries(
+            char const* dir_path, std::string const& dir_id) const;
+
+        // The contents of the file at file_path, if this revision is
+        // being loaded from a dump that carried them in full, or null
+        std::string const* loaded_file(char const* file_path) const;
+
+        svn const& repo;
         AprPool pool;
         svn_fs_root_t* fs_root;
         int revnum;
@@ -66,9 +108,21 @@ class svn
     }
     
     static AprPool global_pool;
+    std::string repo_path;
     svn_repos_t* repos;
     svn_fs_t* fs;
     Authors authors;
+
+    // Maps paths, without a leading slash, to file contents
+    typedef std::unordered_map<std::string, std::string> loaded_file_map;
+
+ private:
+    mutable lru_cache<std::string, std::shared_ptr<directory const> > directories;
+
+    // The files carried in full by the dump for the revision being
+    // loaded, and its number, or -1
+    loaded_file_map loaded_files;
+    int loaded_files_revnum;
 };
 
 #endif
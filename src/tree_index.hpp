@@ -0,0 +1,241 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+#ifndef TREE_INDEX_DWA2013725_HPP
+# define TREE_INDEX_DWA2013725_HPP
+
+# include "path.hpp"
+# include <boost/container/flat_map.hpp>
+# include <memory>
+# include <string>
+
+// What we know about the contents of a Git tree, as built up from
+// the commands sent to git fast-import.  Lets us tell whether a
+// commit changed its tree without asking fast-import.
+//
+// Directories are shared, and copied only when written while shared,
+// so copying an index, or a subtree of one into another, is cheap.
+// A subtree written by its Git SHA alone is "opaque": we know its
+// name, but not its contents.  Changing anything inside an opaque
+// subtree leaves the whole index unknown until the root is deleted
+// again.
+class tree_index
+{
+ public:
+    enum comparison { same, different, unknown };
+
+    // A new index is of a known, empty tree
+    tree_index() : known(true) {}
+
+    bool is_known() const { return known; }
+
+    // Forget everything we know
+    void forget()
+    {
+        known = false;
+        root = entry();
+    }
+
+    // Like fast-import's "D <path>"
+    void remove(path const& p)
+    {
+        assign(p, nullptr);
+    }
+
+    // Like fast-import's "M <mode> <sha> <path>"; sha can be anything
+    // that identifies the contents, e.g. a gitlink's mark.
+    void set_file(path const& p, unsigned long mode, std::string const& sha)
+    {
+        entry e;
+        e.mode = mode;
+        e.sha = sha;
+        assign(p, &e);
+    }
+
+    // Like fast-import's "M 040000 <sha> <path>"
+    void set_opaque_tree(path const& p, std::string const& sha)
+    {
+        entry e;
+        e.sha = sha;
+        assign(p, &e);
+    }
+
+    // Like set_opaque_tree, where src_path in src holds the tree
+    // with the given SHA.  If src knows its contents, so will we.
+    void copy_tree(
+        path const& p, std::string const& sha, tree_index const& src, path const& src_path)
+    {
+        entry const* e = src.known ? src.find(src_path) : nullptr;
+        if (e != nullptr && e->is_tree() && !e->is_empty())
+        {
+            entry const copy = *e;
+            assign(p, &copy);
+        }
+        else
+            set_opaque_tree(p, sha);
+    }
+
+    friend comparison compare(tree_index const& lhs, tree_index const& rhs)
+    {
+        if (!lhs.known || !rhs.known)
+            return unknown;
+        return compare(lhs.root, rhs.root);
+    }
+
+ private:
+    static unsigned long const tree_mode = 040000;
+
+    struct directory;
+
+    struct entry
+    {
+        entry() : mode(tree_mode) {}
+
+        unsigned long mode;
+        std::string sha;                      // Empty in known directories
+        std::shared_ptr<directory> contents;  // Null if empty or opaque
+
+        bool is_tree() const { return mode == tree_mode; }
+        bool is_opaque() const { return is_tree() && !sha.empty(); }
+        bool is_empty() const { return is_tree() && sha.empty() && !contents; }
+    };
+
+    struct directory
+    {
+        boost::container::flat_map<std::string, entry> entries;
+    };
+
+    struct unknown_contents {};
+
+    void assign(path const& p, entry const* e)
+    {
+        // Replacing the whole tree makes it known again
+        if (p.str().empty())
+        {
+            known = true;
+            root = e ? *e : entry();
+            return;
+        }
+
+        if (!known)
+            return;
+        try
+        {
+            assign(root, path::component_iterator(p), path::component_iterator(p.str().end()), e);
+        }
+        catch(unknown_contents)
+        {
+            forget();
+        }
+    }
+
+    // Replace the entry at [first, last) in tree by *e, or remove it
+    // if e is null.  Git has no empty directories, so neither does
+    // the index.
+    static void assign(
+        entry& tree, path::component_iterator first, path::component_iterator last,
+        entry const* e)
+    {
+        if (first == last)
+        {
+            tree = e ? *e : entry();
+            return;
+        }
+
+        if (tree.is_opaque())
+            throw unknown_contents();
+
+        // There's nothing to delete beneath a file, but writing
+        // beneath it replaces it with a directory
+        if (!tree.is_tree())
+        {
+            if (e == nullptr)
+                return;
+            tree = entry();
+        }
+
+        if (!tree.contents)
+            tree.contents = std::make_shared<directory>();
+        else if (tree.contents.use_count() > 1)
+            tree.contents = std::make_shared<directory>(*tree.contents);
+
+        auto& entries = tree.contents->entries;
+        std::string const name(first->begin(), first->end());
+        auto p = entries.find(name);
+        if (p == entries.end())
+        {
+            if (e != nullptr)
+                p = entries.emplace(name, entry()).first;
+        }
+        if (p != entries.end())
+        {
+            assign(p->second, ++first, last, e);
+            if (p->second.is_empty())
+                entries.erase(p);
+        }
+
+        if (entries.empty())
+            tree.contents.reset();
+    }
+
+    entry const* find(path const& p) const
+    {
+        entry const* e = &root;
+        for (path::component_iterator i(p), end(p.str().end()); i != end; ++i)
+        {
+            if (e->is_opaque())
+                return nullptr;
+            if (!e->is_tree() || !e->contents)
+                return nullptr;
+            auto q = e->contents->entries.find(std::string(i->begin(), i->end()));
+            if (q == e->contents->entries.end())
+                return nullptr;
+            e = &q->second;
+        }
+        return e;
+    }
+
+    static comparison compare(entry const& lhs, entry const& rhs)
+    {
+        if (!lhs.is_tree() || !rhs.is_tree())
+            return lhs.mode == rhs.mode && lhs.sha == rhs.sha ? same : different;
+
+        if (lhs.contents == rhs.contents && lhs.sha == rhs.sha)
+            return same;
+
+        // Git names every tree by its contents
+        if (lhs.is_opaque() && rhs.is_opaque())
+            return different;
+
+        if (lhs.is_opaque() || rhs.is_opaque())
+            return unknown;
+
+        // Both are known directories, at most one of them empty
+        if (!lhs.contents || !rhs.contents)
+            return different;
+
+        auto const& l = lhs.contents->entries;
+        auto const& r = rhs.contents->entries;
+        if (l.size() != r.size())
+            return different;
+
+        comparison result = same;
+        for (auto i = l.begin(), j = r.begin(); i != l.end(); ++i, ++j)
+        {
+            if (i->first != j->first)
+                return different;
+            comparison c = compare(i->second, j->second);
+            if (c == different)
+                return different;
+            if (c == unknown)
+                result = unknown;
+        }
+        return result;
+    }
+
+ private:
+    bool known;
+    entry root;
+};
+
+#endif // TREE_INDEX_DWA2013725_HPP
@@ -0,0 +1,62 @@
+# Convert the test repository twice: directly, and by piping "svnadmin
+# dump" into svn2git --svndump.  The dump goes in twice: the first time
+# loading stops at --max-rev, and the second time the revisions already
+# loaded have to be skipped.  Each ref must end up with the same tree
+# either way.
+
+set(svn2git_args
+  --git "${GIT}" --exit-success --authors "${AUTHORS}" --rules "${RULES}")
+set(from_dump "${WORK_DIR}/from-dump")
+set(from_repo "${WORK_DIR}/from-repo")
+set(dump_args
+  --svnrepo "${WORK_DIR}/loaded-repo" --svndump - --state-file "${WORK_DIR}/state")
+
+file(REMOVE_RECURSE "${WORK_DIR}")
+file(MAKE_DIRECTORY "${from_dump}" "${from_repo}")
+
+function(launch)
+  execute_process(COMMAND ${ARGV} RESULT_VARIABLE result_code)
+  if(NOT result_code STREQUAL 0)
+    message(FATAL_ERROR "${ARGV}:\n"
+      "Process failed with result \"${result_code}\"")
+  endif()
+endfunction()
+
+launch("${SVN2GIT}" ${svn2git_args} --svnrepo "${REPO_PATH}"
+  WORKING_DIRECTORY "${from_repo}")
+
+launch("${SVNADMIN}" dump --quiet "${REPO_PATH}"
+  COMMAND "${SVN2GIT}" ${svn2git_args} ${dump_args} --max-rev 5
+  WORKING_DIRECTORY "${from_dump}")
+
+# Nothing past --max-rev may have been loaded
+launch("${SVNADMIN}" dump --quiet -r 5 "${WORK_DIR}/loaded-repo" OUTPUT_QUIET)
+execute_process(COMMAND "${SVNADMIN}" dump --quiet -r 6 "${WORK_DIR}/loaded-repo"
+  OUTPUT_QUIET ERROR_QUIET RESULT_VARIABLE result_code)
+if(result_code STREQUAL 0)
+  message(FATAL_ERROR "Loading the dump went on past --max-rev")
+endif()
+
+launch("${SVNADMIN}" dump --quiet "${REPO_PATH}"
+  COMMAND "${SVN2GIT}" ${svn2git_args} ${dump_args}
+  WORKING_DIRECTORY "${from_dump}")
+
+function(ref_trees git_dir result)
+  execute_process(COMMAND "${GIT}" for-each-ref "--format=%(refname) %(tree)"
+    WORKING_DIRECTORY "${git_dir}"
+    OUTPUT_VARIABLE output
+    RESULT_VARIABLE result_code)
+  if(NOT result_code STREQUAL 0 OR output STREQUAL "")
+    message(FATAL_ERROR "Couldn't list the refs in ${git_dir}")
+  endif()
+  set(${result} "${output}" PARENT_SCOPE)
+endfunction()
+
+foreach(repo everything svn2git-fallback)
+  ref_trees("${from_repo}/${repo}" expected)
+  ref_trees("${from_dump}/${repo}" actual)
+  if(NOT actual STREQUAL expected)
+    message(FATAL_ERROR "Converting ${repo} from a dump gave\n${actual}\n"
+      "instead of\n${expected}")
+  endif()
+endforeach()
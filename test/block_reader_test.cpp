@@ -0,0 +1,100 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "block_reader.hpp"
+#include <cassert>
+#include <cstdio>
+#include <string>
+#include <thread>
+
+// Write s to fd and close it
+static void write_and_close(int fd, std::string const& s)
+{
+    for (std::size_t done = 0; done < s.size();)
+    {
+        ssize_t const n = ::write(fd, s.data() + done, s.size() - done);
+        assert(n > 0);
+        done += n;
+    }
+    ::close(fd);
+}
+
+static std::string contents_of(int fd)
+{
+    std::string s;
+    ::lseek(fd, 0, SEEK_SET);
+    char buf[4096];
+    for (ssize_t n; (n = ::read(fd, buf, sizeof(buf))) > 0;)
+        s.append(buf, n);
+    return s;
+}
+
+static int temp_fd()
+{
+    return ::fileno(std::tmpfile());
+}
+
+// Copy input to a file, passing the payload of each "data <n>" line
+// through forward()
+static std::string copy(int in_fd, std::size_t capacity)
+{
+    int const out_fd = temp_fd();
+    block_reader in(in_fd, capacity);
+    output_buffer out(
+        capacity, [&](char const* s, std::size_t n){ write_and_close(::dup(out_fd), std::string(s, n)); });
+
+    boost::string_ref line;
+    while (in.getline(line))
+    {
+        out.put(line);
+        out.put('\n');
+        if (line.starts_with("data "))
+            in.forward(std::stoul(std::string(line.substr(5))), out, out_fd);
+    }
+    out.flush();
+    return contents_of(out_fd);
+}
+
+int main()
+{
+    std::string const big(100000, 'x');
+    std::string const input
+        = "commit refs/heads/master\n"
+          "data 5\nhello\n"
+          "a line longer than the buffer, which has to grow to hold it\n"
+          "\n"
+          "data " + std::to_string(big.size()) + "\n" + big
+        + "data 0\n"
+          "M 160000 :1 path\n"
+          "no newline";
+    std::string const expected = input + "\n";
+
+    // From a file, tiny and big buffers
+    for (std::size_t capacity : { 16, 1 << 20 })
+    {
+        int const fd = temp_fd();
+        write_and_close(::dup(fd), input);
+        ::lseek(fd, 0, SEEK_SET);
+        assert(copy(fd, capacity) == expected);
+    }
+
+    // From a pipe, where payloads are spliced
+    int p[2];
+    assert(::pipe(p) == 0);
+    std::thread writer(write_and_close, p[1], input);
+    assert(copy(p[0], 16) == expected);
+    writer.join();
+    ::close(p[0]);
+
+    // A payload running off the end is an error
+    {
+        int const fd = temp_fd();
+        write_and_close(::dup(fd), "data 10\nshort");
+        ::lseek(fd, 0, SEEK_SET);
+        bool threw = false;
+        try { copy(fd, 16); } catch (std::runtime_error const&) { threw = true; }
+        assert(threw);
+    }
+}
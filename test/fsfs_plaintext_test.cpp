@@ -0,0 +1,91 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "fsfs_plaintext.hpp"
+#include <boost/filesystem.hpp>
+#include <cassert>
+#include <fstream>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+static void write_file(fs::path const& p, std::string const& contents)
+{
+    fs::create_directories(p.parent_path());
+    std::ofstream(p.string(), std::ios::binary) << contents;
+}
+
+static std::string contents_of(boost::optional<file_region> const& r)
+{
+    assert(r);
+    mapped_region m(*r);
+    return std::string(m.data(), r->size);
+}
+
+int main()
+{
+    fs::path const repo = fs::temp_directory_path() / fs::unique_path();
+    fs::path const revs = repo / "db" / "revs";
+    write_file(repo / "db" / "format", "6\nlayout sharded 4\n");
+
+    // r2 holds a plain and a deltified representation
+    std::string const r2_junk = "junk\n";
+    std::string const plain_rep = "PLAIN\nhello world\nENDREP\n";
+    std::string const r2 = r2_junk + plain_rep + "DELTA\nSVN\1xxxxENDREP\n";
+    std::string const plain_offset = std::to_string(r2_junk.size());
+    std::string const delta_offset = std::to_string(r2_junk.size() + plain_rep.size());
+    write_file(revs / "0" / "2", r2);
+
+    // r3 holds node-revisions referring to them
+    std::string const file_node
+        = "id: 0.0.r3/0\ntype: file\ncount: 1\n"
+          "text: 2 " + plain_offset + " 12 12 0123456789abcdef\ncpath: /a\n\n";
+    std::string const delta_id = "1.0.r3/" + std::to_string(file_node.size());
+    std::string const delta_node
+        = "id: " + delta_id + "\ntype: file\ntext: 2 " + delta_offset + " 8 12 0123\n\n";
+    std::string const dir_id 
+        = "2.0.r3/" + std::to_string(file_node.size() + delta_node.size());
+    std::string const dir_node
+        = "id: " + dir_id + "\ntype: dir\ntext: 2 " + plain_offset + " 12 12 0123\n\n";
+    write_file(revs / "0" / "3", file_node + delta_node + dir_node);
+
+    // r4 and r5 are packed together
+    std::string const r4 = "r4 stuff\n";
+    std::string const packed_rep = "PLAIN\npacked!\nENDREP\n";
+    std::string const packed_id = "3.0.r5/" + std::to_string(packed_rep.size());
+    std::string const r5 
+        = packed_rep + "id: " + packed_id + "\ntype: file\ntext: 5 0 8 0 0123\n\n";
+    write_file(revs / "1.pack" / "pack", r4 + r5);
+    write_file(revs / "1.pack" / "manifest", "0\n" + std::to_string(r4.size()) + "\n");
+
+    {
+        fsfs_plaintext p(repo.string());
+
+        assert(contents_of(p.find("0.0.r3/0", 12)) == "hello world\n");
+        assert(contents_of(p.find(packed_id, 8)) == "packed!\n");
+
+        // The expected size must match
+        assert(!p.find("0.0.r3/0", 11));
+
+        // Deltified contents and directories aren't found
+        assert(!p.find(delta_id, 12));
+        assert(!p.find(dir_id, 12));
+
+        // Nor is anything that isn't there
+        assert(!p.find("0.0.r9/0", 12));
+        assert(!p.find("0.0.r3/3", 12));
+        assert(!p.find("garbage", 12));
+        assert(!p.find("0.0.r3/0x", 12));
+    }
+
+    // Newer formats aren't understood
+    write_file(repo / "db" / "format", "7\nlayout sharded 4\naddressing logical\n");
+    {
+        fsfs_plaintext p(repo.string());
+        assert(!p.find("0.0.r3/0", 12));
+    }
+
+    fs::remove_all(repo);
+}
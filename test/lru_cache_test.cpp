@@ -0,0 +1,45 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "lru_cache.hpp"
+#include <cassert>
+#include <string>
+
+int main()
+{
+    lru_cache<std::string, int> c(2);
+    assert(c.size() == 0);
+    assert(!c.find("a"));
+
+    c.insert("a", 1);
+    c.insert("b", 2);
+    assert(c.size() == 2);
+    assert(*c.find("a") == 1);
+    assert(*c.find("b") == 2);
+
+    // "a" was used least recently, so it makes room for "c"
+    c.insert("c", 3);
+    assert(c.size() == 2);
+    assert(!c.find("a"));
+    assert(*c.find("b") == 2);
+    assert(*c.find("c") == 3);
+
+    // Finding "b" makes "c" the one to go
+    assert(c.find("b"));
+    c.insert("d", 4);
+    assert(!c.find("c"));
+    assert(*c.find("b") == 2);
+    assert(*c.find("d") == 4);
+
+    // Replacing a value doesn't evict anything
+    c.insert("b", 5);
+    assert(c.size() == 2);
+    assert(*c.find("b") == 5);
+    assert(*c.find("d") == 4);
+
+    c.clear();
+    assert(c.size() == 0);
+    assert(!c.find("b"));
+}
@@ -0,0 +1,74 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "mark_sha_map.hpp"
+#include <boost/filesystem.hpp>
+#include <cassert>
+#include <fstream>
+#include <string>
+
+namespace fs = boost::filesystem;
+
+static fs::path const marks_file = fs::temp_directory_path() / fs::unique_path();
+
+static void write_marks(std::string const& contents)
+{
+    std::ofstream(marks_file.string(), std::ios::binary) << contents;
+}
+
+// True iff loading contents fails
+static bool rejects(std::string const& contents)
+{
+    write_marks(contents);
+    mark_sha_map m;
+    try
+    {
+        m.load(marks_file.string());
+    }
+    catch (std::runtime_error const&)
+    {
+        return true;
+    }
+    return false;
+}
+
+int main()
+{
+    std::string const sha_a = "0123456789abcdef0123456789abcdef01234567";
+    std::string const sha_b = "fedcba9876543210fedcba9876543210fedcba98";
+    std::string const sha_c = "4b825dc642cb6eb9a060e54bf8d69288fbee4904";
+
+    write_marks(":1 " + sha_a + "\n:3 " + sha_b + "\n:1000 " + sha_c + "\n");
+    mark_sha_map m;
+    m.load(marks_file.string());
+    assert(m.find(1) && sha1::to_hex(*m.find(1)) == sha_a);
+    assert(m.find(3) && sha1::to_hex(*m.find(3)) == sha_b);
+    assert(m.find(1000) && sha1::to_hex(*m.find(1000)) == sha_c);
+    assert(!m.find(0));
+    assert(!m.find(2));
+    assert(!m.find(999));
+    assert(!m.find(1001));
+    assert(!m.find(std::size_t(-1)));
+
+    // An empty file maps nothing
+    write_marks("");
+    mark_sha_map empty;
+    empty.load(marks_file.string());
+    assert(!empty.find(1));
+
+    assert(rejects(":1 " + sha_a + "\n:1 " + sha_b + "\n"));      // Duplicate
+    assert(rejects("1 " + sha_a + "\n"));                        // No colon
+    assert(rejects(": " + sha_a + "\n"));                        // No mark
+    assert(rejects(":1 " + sha_a.substr(1) + "\n"));             // Short SHA
+    assert(rejects(":1 " + sha_a));                              // No newline
+    assert(rejects(":1 " + sha_a.substr(1) + "g\n"));            // Not hex
+    assert(rejects(":99999999999999999999 " + sha_a + "\n"));    // Huge mark
+
+    // Nor can a missing file be loaded
+    fs::remove(marks_file);
+    bool threw = false;
+    try { mark_sha_map().load(marks_file.string()); } catch (std::runtime_error const&) { threw = true; }
+    assert(threw);
+}
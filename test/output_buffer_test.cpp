@@ -0,0 +1,56 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "output_buffer.hpp"
+#include <cassert>
+#include <string>
+#include <vector>
+
+int main()
+{
+    std::string out;
+    std::vector<std::size_t> writes;
+    output_buffer b(
+        8, [&](char const* s, std::size_t n) { out.append(s, n); writes.push_back(n); });
+
+    // Nothing reaches the sink until the buffer fills or is flushed
+    b.put("M ");
+    b.put_unsigned(0100644, 8);
+    assert(out.empty());
+    b.put(' ');
+    assert(out == "M 100644");
+    b.flush();
+    assert(out == "M 100644 ");
+    b.flush();
+    assert(writes.size() == 2);
+
+    // Numbers
+    out.clear();
+    b.put_unsigned(0);
+    b.put(' ');
+    b.put_unsigned(18446744073709551615ULL);
+    b.put(' ');
+    b.put_unsigned(040000, 8);
+    b.flush();
+    assert(out == "0 18446744073709551615 40000");
+
+    // A write too big for the buffer goes straight to the sink, after
+    // what was already buffered
+    out.clear();
+    writes.clear();
+    std::string const big(100, 'x');
+    b.put("data ");
+    b.write(big.data(), big.size());
+    assert(out == "data " + big);
+    assert(writes.size() == 2 && writes[1] == big.size());
+
+    // A smaller one that doesn't fit starts a new buffer
+    out.clear();
+    b.put("abcdef");
+    b.put("ghij");
+    assert(out == "abcdef");
+    b.flush();
+    assert(out == "abcdefghij");
+}
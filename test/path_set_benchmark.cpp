@@ -0,0 +1,53 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Times inserting 100k random paths into a path_set, as when a big
+// merge touches that many paths in one revision, and checks the
+// result against a straightforward computation.
+
+#undef NDEBUG
+#include "path_set.hpp"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+int main()
+{
+    std::mt19937 random(42);
+    std::vector<path> paths;
+    for (int i = 0; i < 100000; ++i)
+    {
+        // Mostly deep paths within a small tree of directories, so
+        // that some subsume others
+        std::string p = "trunk";
+        int const depth = 4 + random() % 5;
+        for (int d = 0; d < depth; ++d)
+            p += "/d" + std::to_string(random() % (d < 2 ? 8 : 50));
+        paths.push_back(p);
+    }
+
+    auto const start = std::chrono::steady_clock::now();
+    path_set s;
+    for (auto const& p : paths)
+        s.insert(p);
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+
+    std::cout << paths.size() << " inserts, " << s.size() << " paths remain: "
+              << std::chrono::duration<double, std::milli>(elapsed).count() << "ms" << std::endl;
+
+    // Sorted, every path that isn't beneath the last one kept
+    std::sort(paths.begin(), paths.end());
+    std::vector<path> expected;
+    for (auto const& p : paths)
+    {
+        if (expected.empty() || !p.starts_with(expected.back()))
+            expected.push_back(p);
+    }
+    assert(s.size() == expected.size());
+    assert(std::equal(s.begin(), s.end(), expected.begin()));
+}
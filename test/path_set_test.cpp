@@ -4,8 +4,37 @@
 
 #undef NDEBUG
 #include "path_set.hpp"
+#include <boost/container/pmr/global_resource.hpp>
+#include <boost/container/pmr/memory_resource.hpp>
+#include <algorithm>
 #include <cassert>
 #include <iostream>
+#include <string>
+
+// Keeps track of how much is allocated through it
+struct counting_resource : boost::container::pmr::memory_resource
+{
+    counting_resource() : bytes(0) {}
+    std::size_t bytes;
+
+ private:
+    void* do_allocate(std::size_t n, std::size_t alignment)
+    {
+        bytes += n;
+        return boost::container::pmr::new_delete_resource()->allocate(n, alignment);
+    }
+
+    void do_deallocate(void* p, std::size_t n, std::size_t alignment)
+    {
+        bytes -= n;
+        boost::container::pmr::new_delete_resource()->deallocate(p, n, alignment);
+    }
+
+    bool do_is_equal(boost::container::pmr::memory_resource const& other) const BOOST_NOEXCEPT
+    {
+        return this == &other;
+    }
+};
 
 int main()
 {
@@ -40,4 +69,36 @@ int main()
     s2.insert("x/y");
     path_set expected2 = { "a", "a.txt/bb", "x", "x.txt/yy" };
     assert(s2 == expected2);
+
+    // The tree and its components' names come from the given resource
+    {
+        std::string const dir = "a_directory_name_too_long_to_be_stored_inline";
+        counting_resource short_counted, long_counted;
+        path_set short_named(&short_counted), long_named(&long_counted);
+        for (auto file : { "first_file.txt", "second_file.txt" })
+        {
+            short_named.insert(path("d") / file);
+            long_named.insert(path(dir) / file);
+        }
+        assert(long_named.size() == 2);
+        assert(long_counted.bytes >= short_counted.bytes + dir.size());
+        long_named.clear();
+        assert(long_counted.bytes == 0);
+    }
+
+    // Paths are ordered component by component
+    char const* ordered[] = { "", "a", "a/b", "a/b/c", "a/b.c", "a/bc", "a.txt", "a.txt/b", "ab", "b" };
+    for (auto x : ordered)
+    {
+        for (auto y : ordered)
+            assert((path(x) < path(y)) == (std::find(ordered, std::end(ordered), x) 
+                                           < std::find(ordered, std::end(ordered), y)));
+    }
+
+    // Joining normalizes the separators between components
+    path const p("x/foo/bar/");
+    assert((path("x") / p.sans_prefix("x")).str() == "x/foo/bar");
+    assert((path() / p.sans_prefix("x/foo")).str() == "bar");
+    assert((path("y") / p.sans_prefix("x/foo/bar")).str() == "y");
+    assert((path("y") / "/z/").str() == "y/z");
 }
@@ -7,6 +7,8 @@
 #include "patrie.hpp"
 #include <boost/fusion/adapted/struct/define_struct.hpp>
 #include <cassert>
+#include <iterator>
+#include <vector>
 
 namespace patrie_test {
 
@@ -69,10 +71,123 @@ int main()
         assert(p.longest_match(test, 6) == 0);
     }
 
+    {
+        // The compiled trie finds the same rules
+        patrie<Rule> c = p;
+        c.compile();
+        char const* tests[] = {
+            "", "abra", "abra/", "abra/cadabra", "abra/cadabra/x", "abra/cadaver",
+            "abra/hams", "abra/hams/on", "abra/hamster", "abracadabra", "quantico"
+        };
+        for (std::string test : tests)
+        {
+            for (int rev = 0; rev <= 6; ++rev)
+            {
+                assert(c.longest_match(test, rev) == p.longest_match(test, rev));
+
+                // ...also when resuming a search from the parent directory
+                std::size_t slash = test.rfind('/');
+                if (slash == std::string::npos)
+                    continue;
+                auto cursor = c.begin_search(rev);
+                c.advance(cursor, test.begin(), test.begin() + slash, rev);
+                assert(c.longest_match(cursor, std::string(test, slash), rev) 
+                       == p.longest_match(test, rev));
+            }
+        }
+    }
+
     {
         std::string test = "abra/hams/on";
         assert(*p.longest_match(test, 1) == rules[3]);
         assert(*p.longest_match(test, 2) == rules[2]);
         assert(p.longest_match(test, 5) == 0);
     }
+
+    {
+        std::vector<Rule const*> found;
+        auto out = std::back_inserter(found);
+
+        p.svn_subtree_rules(std::string("abra/cadabra"), 2, out);
+        assert(found.size() == 1 && *found[0] == rules[1]);
+
+        found.clear();
+        p.svn_subtree_rules(std::string("abra/cad"), 2, out);
+        assert(found.empty());
+
+        found.clear();
+        p.svn_subtree_rules(std::string("abra"), 1, out);
+        assert(found.size() == 4);
+    }
+
+    {
+        // Rules mapped to the root of a Git ref
+        Rule root_rules[2]
+        = {
+            {"trunk",          "r:master:",    1, 9},
+            {"trunk/libs/foo", "r:master:foo", 1, 9}
+        };
+        patrie<Rule> q;
+        for(auto const& m: root_rules)
+            q.insert(m);
+
+        std::vector<Rule const*> found;
+        q.git_subtree_rules(std::string("r:master:"), 1, std::back_inserter(found));
+        assert(found.size() == 2);
+
+        // Paths that end in the middle of a node
+        found.clear();
+        q.svn_subtree_rules(std::string("trunk/libs"), 1, std::back_inserter(found));
+        assert(found.size() == 1 && *found[0] == root_rules[1]);
+
+        found.clear();
+        q.svn_subtree_rules(std::string("trunk/li"), 1, std::back_inserter(found));
+        assert(found.empty());
+
+        patrie<Rule> r;
+        r.insert(root_rules[1]);
+        found.clear();
+        r.git_subtree_rules(std::string("r:master:"), 1, std::back_inserter(found));
+        assert(found.size() == 1);
+
+        found.clear();
+        q.git_subtree_rules(std::string("r:master:fo"), 1, std::back_inserter(found));
+        assert(found.empty());
+    }
+
+    {
+        // A deleted or replaced SVN directory invalidates the rules
+        // mapping paths nested beneath it, whichever Git repositories
+        // they map into
+        Rule nested_rules[4]
+        = {
+            {"trunk/boost/config",   "boost:master:boost/config", 1, 9},
+            {"trunk/libs/config",    "config:master:",            1, 9},
+            {"trunk/libs/configure", "configure:master:",         1, 9},
+            {"trunk/libs/config",    "config:master:",            10, 12}
+        };
+        patrie<Rule> n;
+        for(auto const& m: nested_rules)
+            n.insert(m);
+
+        std::vector<Rule const*> found;
+        n.svn_subtree_rules(std::string("trunk/libs/config"), 5, std::back_inserter(found));
+        assert(found.size() == 1 && *found[0] == nested_rules[1]);
+
+        found.clear();
+        n.svn_subtree_rules(std::string("trunk/libs/config"), 11, std::back_inserter(found));
+        assert(found.size() == 1 && *found[0] == nested_rules[3]);
+
+        found.clear();
+        n.svn_subtree_rules(std::string("trunk/libs"), 5, std::back_inserter(found));
+        assert(found.size() == 2);
+
+        found.clear();
+        n.svn_subtree_rules(std::string("trunk"), 5, std::back_inserter(found));
+        assert(found.size() == 3);
+
+        found.clear();
+        n.svn_subtree_rules(std::string("trunk/boost"), 11, std::back_inserter(found));
+        assert(found.empty());
+    }
 };
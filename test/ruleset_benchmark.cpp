@@ -0,0 +1,166 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+// Times the lookups made for every converted file against a real
+// ruleset, and path_set/path comparison on the resulting paths.
+//
+// Usage: ruleset_benchmark RULES-FILE [QUERIES-FILE]
+//
+// QUERIES-FILE holds one "REVISION SVN-PATH" query per line, e.g. as
+// recorded from a repository with
+//
+//   for r in $(seq 1 $(svnlook youngest REPO)); do
+//     svnlook changed -r $r REPO | sed "s|^.... *|$r |"; done
+//
+// Without one, queries are made up from the paths of the rules in
+// effect at a spread of revisions.
+
+#include "ruleset.hpp"
+#include "options.hpp"
+#include "path_set.hpp"
+#include <boost/function_output_iterator.hpp>
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+Options options;
+
+struct query
+{
+    std::size_t revision;
+    std::string svn_path;
+};
+
+static std::vector<query> read_queries(std::string const& filename)
+{
+    std::ifstream in(filename);
+    if (!in)
+        throw std::runtime_error("Couldn't open queries file: " + filename);
+
+    std::vector<query> queries;
+    query q;
+    while (in >> q.revision && std::getline(in >> std::ws, q.svn_path))
+        queries.push_back(q);
+    return queries;
+}
+
+static std::vector<query> make_queries(Ruleset const& ruleset)
+{
+    static char const* const suffixes[] = {
+        "", "/index.html", "/include/boost/x.hpp", "/src/x.cpp",
+        "/test/Jamfile.v2", "/doc/html/x/y.html", "/unmapped/z" };
+
+    std::mt19937 random(42);
+    std::vector<query> queries;
+    for (std::size_t revision = 1; revision < 90000; revision += 3001)
+    {
+        std::vector<Rule const*> rules;
+        ruleset.matcher().rules_in_effect(revision, std::back_inserter(rules));
+        for (auto r : rules)
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                query q = { revision, r->svn_path().str() };
+                q.svn_path += suffixes[random() % (sizeof(suffixes) / sizeof(*suffixes))];
+                queries.push_back(q);
+            }
+        }
+    }
+    std::shuffle(queries.begin(), queries.end(), random);
+    return queries;
+}
+
+// Run f and report the time taken per each of n operations
+template <class F>
+static void time(char const* what, std::size_t n, F f)
+{
+    auto const start = std::chrono::steady_clock::now();
+    f();
+    auto const elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << what << ": " << n << " in "
+              << std::chrono::duration<double, std::milli>(elapsed).count() << "ms, "
+              << std::chrono::duration<double, std::nano>(elapsed).count() / n << "ns each"
+              << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        std::cerr << "usage: " << argv[0] << " RULES-FILE [QUERIES-FILE]" << std::endl;
+        return 1;
+    }
+    options.rules_file = argv[1];
+
+    std::unique_ptr<Ruleset> ruleset;
+    time("parse and compile rules", 1, [&]{ ruleset.reset(new Ruleset(argv[1])); });
+    auto const& matcher = ruleset->matcher();
+
+    std::vector<query> const queries
+        = argc == 3 ? read_queries(argv[2]) : make_queries(*ruleset);
+    std::size_t const n = queries.size();
+
+    // Counted so the work can't be optimized away
+    std::size_t found = 0;
+    auto count = boost::make_function_output_iterator([&](Rule const*){ ++found; });
+
+    std::vector<Rule const*> matches(n);
+    time("longest_match", n, [&]{
+            for (std::size_t i = 0; i < n; ++i)
+                matches[i] = matcher.longest_match(queries[i].svn_path, queries[i].revision);
+        });
+
+    time("svn_subtree_rules", n, [&]{
+            for (auto const& q : queries)
+                matcher.svn_subtree_rules(q.svn_path, q.revision, count);
+        });
+
+    // Look up the Git side of each match, as importer::maps_wholesale does
+    std::vector<std::string> git_addresses;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+        if (Rule const* r = matches[i])
+        {
+            path const rest = path(queries[i].svn_path).sans_prefix(r->svn_path());
+            git_addresses.push_back(
+                r->git_repo_name() + ":" + r->git_ref_name() + ":" + (r->git_path()/rest).str());
+        }
+        else
+            git_addresses.push_back(std::string());
+    }
+    time("git_subtree_rules", n, [&]{
+            for (std::size_t i = 0; i < n; ++i)
+            {
+                if (matches[i])
+                    matcher.git_subtree_rules(git_addresses[i], queries[i].revision, count);
+            }
+        });
+
+    std::vector<path> paths;
+    for (auto const& q : queries)
+        paths.push_back(q.svn_path);
+
+    path_set s;
+    time("path_set::insert", n, [&]{
+            for (auto const& p : paths)
+                s.insert(p);
+        });
+
+    std::size_t comparisons = 0;
+    time("path::operator< (in std::sort)", n, [&]{
+            std::sort(paths.begin(), paths.end(),
+                      [&](path const& x, path const& y){ ++comparisons; return x < y; });
+        });
+
+    std::cout << std::count(matches.begin(), matches.end(), nullptr) << " unmatched, "
+              << found << " subtree rules, " << s.size() << " paths in path_set, "
+              << comparisons << " comparisons" << std::endl;
+}
@@ -0,0 +1,32 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "sha1.hpp"
+#include <cassert>
+#include <string>
+
+int main()
+{
+    assert(sha1().hex_digest() == "da39a3ee5e6b4b0d3255bfef95601890afd80709");
+    assert(sha1().update("abc").hex_digest() == "a9993e364706816aba3e25717850c26c9cd0d89d");
+    assert(sha1().update("abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq").hex_digest()
+           == "84983e441c3bd26ebaae4aa1f95129e5e54670f1");
+
+    // Feeding the same data in pieces of different sizes doesn't matter
+    std::string million(1000000, 'a');
+    sha1 pieces;
+    for (std::size_t i = 0, n = 1; i < million.size(); i += n, n = n % 97 + 1)
+        pieces.update(million.data() + i, std::min(n, million.size() - i));
+    assert(pieces.hex_digest() == "34aa973cd4c4daa4f61eeb2bdbad27316534016f");
+    assert(sha1().update(million).hex_digest() == pieces.hex_digest());
+
+    // The names Git gives to blobs; compare `git hash-object`
+    assert(git_blob_sha("", 0) == "e69de29bb2d1d6434b8b29ae775ad8c2e48c5391");
+    std::string const hello = "hello world\n";
+    assert(git_blob_sha(hello.data(), hello.size()) == "3b18e512dba79e4c8300dd08aeb37f8e728b8dad");
+
+    std::string const hex = "3B18e512dba79e4c8300dd08aeb37f8e728b8dad";
+    assert(sha1::to_hex(sha1::from_hex(hex)) == "3b18e512dba79e4c8300dd08aeb37f8e728b8dad");
+}
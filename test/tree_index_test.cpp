@@ -0,0 +1,89 @@
+// Copyright Dave Abrahams 2013. Distributed under the Boost
+// Software License, Version 1.0. (See accompanying
+// file LICENSE_1_0.txt or copy at http://www.boost.org/LICENSE_1_0.txt)
+
+#undef NDEBUG
+#include "tree_index.hpp"
+#include <cassert>
+
+int main()
+{
+    tree_index empty;
+    tree_index t;
+    assert(compare(t, empty) == tree_index::same);
+
+    t.set_file("a/b/c", 0100644, "1111");
+    t.set_file("a/d", 0100644, "2222");
+    assert(compare(t, empty) == tree_index::different);
+
+    {
+        // Rewriting what's there changes nothing
+        tree_index u = t;
+        u.set_file("a/b/c", 0100644, "1111");
+        assert(compare(t, u) == tree_index::same);
+
+        // ...but a new mode does
+        u.set_file("a/b/c", 0100755, "1111");
+        assert(compare(t, u) == tree_index::different);
+    }
+
+    {
+        // Deleting and rewriting the same contents changes nothing
+        tree_index u = t;
+        u.remove("");
+        assert(compare(u, empty) == tree_index::same);
+        u.set_file("a/d", 0100644, "2222");
+        u.set_file("a/b/c", 0100644, "1111");
+        assert(compare(t, u) == tree_index::same);
+
+        // Git has no empty directories
+        u.remove("a/b/c");
+        tree_index v;
+        v.set_file("a/d", 0100644, "2222");
+        assert(compare(u, v) == tree_index::same);
+
+        // Deleting beneath a file does nothing
+        v.remove("a/d/e");
+        assert(compare(u, v) == tree_index::same);
+    }
+
+    {
+        // Copied subtrees are known
+        tree_index u;
+        u.copy_tree("x", "aaaa", t, "a");
+        tree_index v;
+        v.set_file("x/b/c", 0100644, "1111");
+        v.set_file("x/d", 0100644, "2222");
+        assert(compare(u, v) == tree_index::same);
+
+        // ...unless the source doesn't know them
+        tree_index w;
+        w.copy_tree("x", "aaaa", t, "q");
+        assert(compare(w, v) == tree_index::unknown);
+    }
+
+    {
+        // Opaque trees compare by SHA, but otherwise aren't known
+        tree_index u, v;
+        u.set_opaque_tree("x", "aaaa");
+        v.set_opaque_tree("x", "aaaa");
+        assert(compare(u, v) == tree_index::same);
+        v.set_opaque_tree("x", "bbbb");
+        assert(compare(u, v) == tree_index::different);
+
+        v.set_file("x/y", 0100644, "3333");
+        assert(compare(u, v) == tree_index::unknown);
+        assert(!v.is_known());
+
+        // ...until the root is deleted
+        v.remove("");
+        assert(v.is_known());
+        assert(compare(v, empty) == tree_index::same);
+
+        tree_index w;
+        w.set_file("x/y", 0100644, "3333");
+        assert(compare(u, w) == tree_index::unknown);
+        w.set_file("z", 0100644, "4444");
+        assert(compare(u, w) == tree_index::different);
+    }
+}